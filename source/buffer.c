@@ -1,26 +1,395 @@
+#define _GNU_SOURCE
+#define MEMORY_SUBSYSTEM MEMORY_SUBSYSTEM_BUFFER
 #include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <limits.h>
+#include <stdio.h>
 #include "buffer.h"
+#include "journal.h"
 #include "list.h"
 
+#define min(a, b) (((a) <= (b)) ? (a) : (b))
+#define max(a, b) (((a) >= (b)) ? (a) : (b))
+
 static const size_t initial_file_path_capacity = 4*1024;
 
+static const uint32_t initial_line_capacity = 16;
+
+static const size_t initial_selections_capacity = 16;
+
+static const size_t initial_matches_capacity = 64;
+
+// How many bytes at the start and at the end of the buffer are compared against the file before
+// trusting that it only grew. Files smaller than both together are compared whole.
+static const size_t head_check_size = 4*1024;
+
+static const size_t tail_check_size = 4*1024;
+
+static const size_t tail_read_size = 64*1024;
+
+static const uint64_t hash_multiplier = 0x9fb21c651e98df25;
+
+// Stands in for the text of an empty file, which can't be mapped.
+static char8 empty_text[1];
+
+// Retries short writes and interrupted writes. Returns false if IO error.
+static bool write_all(int fd, char8 *data, size_t size) {
+	while (size) {
+		ssize_t written = write(fd, data, size);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+// Makes a rename in the directory holding `path` durable. Returns false if IO error.
+static bool sync_parent_directory(char *path) {
+	char directory[PATH_MAX];
+	char *slash = strrchr(path, '/');
+	if (!slash) {
+		strcpy(directory, ".");
+	} else if (slash == path) {
+		strcpy(directory, "/");
+	} else {
+		memcpy(directory, path, slash - path);
+		directory[slash - path] = '\0';
+	}
+	int fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+	bool succeeded = fsync(fd) == 0;
+	close(fd);
+	return succeeded;
+}
+
+// Returns false if memory error.
+static bool set_file_path(struct buffer *buffer, char *file_path) {
+	size_t length = strlen(file_path);
+	if (length + 1 > list_get_capacity(&buffer->file_path) && !list_set_capacity(&buffer->file_path, length + 1)) {
+		return false;
+	}
+	memcpy(buffer->file_path, file_path, length + 1);
+	list_set_count(&buffer->file_path, length + 1);
+	return true;
+}
+
+// Replaces `removed_count` lines after the line at `previous_index` (or at the start of the buffer if
+// BUFFER_NONE) with `segment_count` lines taken from `text`. The segments are separated by newlines.
+// Existing lines are overwritten in place before any are inserted or freed. Returns false if memory
+// error.
+static bool splice_lines(struct buffer *buffer, uint32_t previous_index, uint32_t removed_count, char8 *text, size_t size, uint32_t segment_count) {
+	uint32_t line_index = previous_index == BUFFER_NONE ? buffer->first_line_index : buffer->lines[previous_index].next_index;
+	size_t start = 0;
+	for (uint32_t i = 0; i < segment_count; ++i) {
+		char8 *newline = memchr(text + start, '\n', size - start);
+		size_t end = newline ? (size_t)(newline - text) : size;
+		if (i < removed_count) {
+			if (!line_set_text(buffer->lines + line_index, text + start, end - start)) {
+				return false;
+			}
+		} else {
+			line_index = buffer_insert_line(buffer, previous_index);
+			if (line_index == BUFFER_NONE || !line_set_text(buffer->lines + line_index, text + start, end - start)) {
+				return false;
+			}
+		}
+		previous_index = line_index;
+		line_index = buffer->lines[line_index].next_index;
+		start = end + 1;
+	}
+	for (uint32_t i = segment_count; i < removed_count; ++i) {
+		uint32_t next_index = buffer->lines[line_index].next_index;
+		buffer_remove_line(buffer, line_index);
+		line_index = next_index;
+	}
+	return true;
+}
+
+// Moves the line at `from_index` to the unused slot at `to_index`, relinking its neighbors.
+static void move_line(struct buffer *buffer, uint32_t from_index, uint32_t to_index) {
+	struct line *line = buffer->lines + to_index;
+	*line = buffer->lines[from_index];
+	buffer->lines[from_index] = (struct line){0};
+	if (line->previous_index == BUFFER_NONE) {
+		buffer->first_line_index = to_index;
+	} else {
+		buffer->lines[line->previous_index].next_index = to_index;
+	}
+	if (line->next_index == BUFFER_NONE) {
+		buffer->last_line_index = to_index;
+	} else {
+		buffer->lines[line->next_index].previous_index = to_index;
+	}
+}
+
+// Frees every line on the free chain and packs the lines in use into the start of `buffer.lines`,
+// which keeps room for `headroom` more lines.
+static void compact_lines(struct buffer *buffer, uint32_t headroom) {
+	// Freed slots are marked by a NULL text.
+	for (uint32_t line_index = buffer->last_free_line_index; line_index != BUFFER_NONE;) {
+		uint32_t next_index = buffer->lines[line_index].previous_index;
+		line_destroy(buffer->lines + line_index);
+		line_index = next_index;
+	}
+	buffer->last_free_line_index = BUFFER_NONE;
+
+	uint32_t slot_count = list_get_count(&buffer->lines);
+	uint32_t hole_index = 0;
+	for (uint32_t line_index = buffer->line_count; line_index < slot_count; ++line_index) {
+		if (!buffer->lines[line_index].text) {
+			continue;
+		}
+		while (buffer->lines[hole_index].text) {
+			++hole_index;
+		}
+		move_line(buffer, line_index, hole_index);
+	}
+	list_set_count(&buffer->lines, buffer->line_count);
+	// Shrinking can't really fail, and the lines are already packed if it does.
+	size_t capacity = min(list_get_capacity(&buffer->lines), (size_t)buffer->line_count + headroom);
+	if (capacity < list_get_capacity(&buffer->lines)) {
+		list_set_capacity(&buffer->lines, capacity);
+	}
+	buffer->cached_y = BUFFER_NONE;
+}
+
+// Returns true if the buffer's text starts with the `size` bytes of `text`. Lines are joined with
+// newlines, so the check can span any number of lines.
+static bool head_matches(struct buffer *buffer, char8 *text, size_t size) {
+	size_t offset = 0;
+	for (uint32_t line_index = buffer->first_line_index; offset < size; line_index = buffer->lines[line_index].next_index) {
+		if (line_index == BUFFER_NONE) {
+			return false;
+		}
+		struct line *line = buffer->lines + line_index;
+		size_t length = min(line_get_length(line), size - offset);
+		if (memcmp(line->text, text + offset, length) != 0) {
+			return false;
+		}
+		offset += length;
+		if (offset < size && text[offset++] != '\n') {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Returns true if the buffer's text ends with the `size` bytes of `text`.
+static bool tail_matches(struct buffer *buffer, char8 *text, size_t size) {
+	size_t offset = size;
+	for (uint32_t line_index = buffer->last_line_index; offset; line_index = buffer->lines[line_index].previous_index) {
+		if (line_index == BUFFER_NONE) {
+			return false;
+		}
+		struct line *line = buffer->lines + line_index;
+		uint32_t line_length = line_get_length(line);
+		size_t length = min(line_length, offset);
+		if (memcmp(line->text + line_length - length, text + offset - length, length) != 0) {
+			return false;
+		}
+		offset -= length;
+		if (offset && text[--offset] != '\n') {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Returns true if the start and the end of the buffer match the file at the size it had when it was
+// read, meaning the file was only appended to since. A file rewritten in place, as by `>` or a log
+// rotation that truncates, keeps its inode, so the inode alone doesn't tell.
+static bool file_only_grew(struct buffer *buffer, int fd, struct stat *status) {
+	if ((uint64_t)status->st_ino != buffer->file_inode || (uint64_t)status->st_size <= buffer->file_size) {
+		return false;
+	}
+	char8 check[max(head_check_size, tail_check_size)];
+	size_t check_size = min(buffer->file_size, head_check_size);
+	if (pread(fd, check, check_size, 0) != (ssize_t)check_size || !head_matches(buffer, check, check_size)) {
+		return false;
+	}
+	check_size = min(buffer->file_size, tail_check_size);
+	return pread(fd, check, check_size, buffer->file_size - check_size) == (ssize_t)check_size && tail_matches(buffer, check, check_size);
+}
+
+// Reads the bytes past `buffer->file_size` onto the end of the buffer.
+static bool append_file_tail(struct buffer *buffer, int fd, uint64_t new_size, struct line_change *change) {
+	char8 *chunk = list_create(tail_read_size, sizeof *chunk);
+	if (!chunk) {
+		return false;
+	}
+	*change = (struct line_change){.y = buffer->line_count - 1, .removed_count = 1, .inserted_count = 1};
+	bool succeeded = true;
+	uint64_t offset = buffer->file_size;
+	while (succeeded && offset < new_size) {
+		ssize_t read_size = pread(fd, chunk, min(tail_read_size, new_size - offset), offset);
+		if (read_size <= 0) {
+			succeeded = read_size == 0;
+			break;
+		}
+		size_t start = 0;
+		while (start <= (size_t)read_size) {
+			char8 *newline = memchr(chunk + start, '\n', read_size - start);
+			size_t end = newline ? (size_t)(newline - chunk) : (size_t)read_size;
+			if (!line_append_text(buffer->lines + buffer->last_line_index, chunk + start, end - start)) {
+				succeeded = false;
+				break;
+			}
+			if (!newline) {
+				break;
+			}
+			if (buffer_insert_line(buffer, buffer->last_line_index) == BUFFER_NONE) {
+				succeeded = false;
+				break;
+			}
+			++change->inserted_count;
+			start = end + 1;
+		}
+		offset += read_size;
+	}
+	buffer->file_size = offset;
+	list_destroy(&chunk);
+	return succeeded;
+}
+
+// Compares the buffer against the whole file and replaces the lines between the common prefix and
+// the common suffix.
+static bool splice_file(struct buffer *buffer, int fd, struct stat *status, struct line_change *change) {
+	size_t size = status->st_size;
+	char8 *text = empty_text;
+	if (size) {
+		text = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (text == MAP_FAILED) {
+			return false;
+		}
+	}
+
+	// Match lines from the start. `start` ends at the first byte of the first new line that differs.
+	uint32_t prefix_count = 0;
+	uint32_t previous_index = BUFFER_NONE;
+	uint32_t line_index = buffer->first_line_index;
+	size_t start = 0;
+	bool is_text_used = false; // Set once every line of the file has been matched.
+	while (prefix_count < buffer->line_count) {
+		char8 *newline = memchr(text + start, '\n', size - start);
+		size_t end = newline ? (size_t)(newline - text) : size;
+		struct line *line = buffer->lines + line_index;
+		if (line_get_length(line) != end - start || memcmp(line->text, text + start, end - start) != 0) {
+			break;
+		}
+		++prefix_count;
+		previous_index = line_index;
+		line_index = line->next_index;
+		start = end + 1;
+		if (!newline) {
+			is_text_used = true;
+			break;
+		}
+	}
+
+	// Match lines from the end, without crossing into the prefix on either side.
+	uint32_t suffix_count = 0;
+	uint32_t back_index = buffer->last_line_index;
+	size_t end = size;
+	while (!is_text_used && prefix_count + suffix_count < buffer->line_count) {
+		char8 *newline = memrchr(text + start, '\n', end - start);
+		size_t segment_start = newline ? (size_t)(newline - text) + 1 : start;
+		struct line *line = buffer->lines + back_index;
+		if (line_get_length(line) != end - segment_start || memcmp(line->text, text + segment_start, end - segment_start) != 0) {
+			break;
+		}
+		++suffix_count;
+		back_index = line->previous_index;
+		if (!newline) {
+			is_text_used = true;
+			break;
+		}
+		end = newline - text;
+	}
+
+	uint32_t segment_count = 0;
+	if (!is_text_used) {
+		segment_count = 1;
+		for (char8 *newline = text + start; (newline = memchr(newline, '\n', text + end - newline)); ++newline) {
+			++segment_count;
+		}
+	}
+	*change = (struct line_change){
+		.y = prefix_count,
+		.removed_count = buffer->line_count - prefix_count - suffix_count,
+		.inserted_count = segment_count,
+	};
+	bool succeeded = splice_lines(buffer, previous_index, change->removed_count, text + start, end - start, segment_count);
+	if (size) {
+		munmap(text, size);
+	}
+	buffer->file_size = size;
+	buffer->file_inode = status->st_ino;
+	return succeeded;
+}
+
+// Moves a mark to account for lines being replaced.
+static void remap_mark(struct buffer *buffer, struct line_change *change, struct mark *mark) {
+	if (mark->y < change->y) {
+		return;
+	}
+	if (mark->y >= change->y + change->removed_count) {
+		mark->y = mark->y - change->removed_count + change->inserted_count;
+		return;
+	}
+	// The mark was on a replaced line. Keep it on the same row if the row still exists, otherwise move
+	// it to the start of the line after the change.
+	if (mark->y - change->y >= change->inserted_count) {
+		mark->y = change->y + change->inserted_count;
+		mark->x = 0;
+		if (mark->y >= buffer->line_count) {
+			mark->y = buffer->line_count - 1;
+			mark->x = UINT32_MAX;
+		}
+	}
+	uint32_t length = line_get_length(buffer->lines + buffer_get_line_index(buffer, mark->y));
+	mark->x = min(mark->x, length);
+}
+
 bool buffer_initialize(struct buffer *buffer, uint32_t lines_capacity, uint32_t line_character_capaity) {
 	buffer->file_path = list_create(initial_file_path_capacity, sizeof *buffer->file_path);
 	if (!buffer->file_path) {
 		goto error1;
 	}
-	buffer->lines = list_create(lines_capacity, sizeof *buffer->lines);
+	buffer->lines = list_create(max(1, lines_capacity), sizeof *buffer->lines);
 	if (!buffer->lines) {
 		goto error2;
 	}
 	if (!line_initialize(buffer->lines, line_character_capaity)) {
 		goto error3;
 	}
+	list_set_count(&buffer->lines, 1);
+	buffer->file_path[0] = '\0';
+	list_set_count(&buffer->file_path, 1);
 	buffer->first_line_index = 0;
 	buffer->last_line_index = 0;
 	buffer->last_free_line_index = BUFFER_NONE;
+	buffer->line_count = 1;
+	buffer->file_size = 0;
+	buffer->file_inode = 0;
+	buffer->journal = NULL;
+	buffer->is_modified = false;
+	buffer->cached_y = BUFFER_NONE;
+	buffer->cached_line_index = BUFFER_NONE;
 	return true;
 
 error3:
@@ -33,7 +402,7 @@ error1:
 }
 
 void buffer_destroy(struct buffer *buffer) {
-	for (size_t i = 0; i < list_get_count(&buffer); ++i) {
+	for (size_t i = 0; i < list_get_count(&buffer->lines); ++i) {
 		line_destroy(buffer->lines + i);
 	}
 	list_destroy(&buffer->lines);
@@ -41,12 +410,552 @@ void buffer_destroy(struct buffer *buffer) {
 	*buffer = (struct buffer){0};
 }
 
+void buffer_get_memory(struct buffer *buffer, struct buffer_memory *memory) {
+	uint32_t slot_count = list_get_count(&buffer->lines);
+	*memory = (struct buffer_memory){
+		.live_bytes = list_get_allocated_size(&buffer->file_path) + list_get_allocated_size(&buffer->lines),
+		.lines_slack_bytes = (list_get_capacity(&buffer->lines) - slot_count)*sizeof *buffer->lines,
+		.line_slot_count = slot_count,
+		.allocation_count = 2 + slot_count,
+	};
+	for (uint32_t line_index = buffer->first_line_index; line_index != BUFFER_NONE; line_index = buffer->lines[line_index].next_index) {
+		char8 **text = &buffer->lines[line_index].text;
+		memory->live_bytes += list_get_allocated_size(text);
+		memory->text_slack_bytes += list_get_capacity(text) - list_get_count(text);
+	}
+	for (uint32_t line_index = buffer->last_free_line_index; line_index != BUFFER_NONE; line_index = buffer->lines[line_index].previous_index) {
+		size_t size = list_get_allocated_size(&buffer->lines[line_index].text);
+		memory->live_bytes += size;
+		memory->free_line_bytes += size + sizeof *buffer->lines;
+		++memory->free_line_count;
+	}
+}
+
+size_t buffer_get_line_slack_bytes(struct buffer *buffer) {
+	return (list_get_capacity(&buffer->lines) - buffer->line_count)*sizeof *buffer->lines;
+}
+
+size_t buffer_trim(struct buffer *buffer, size_t slack_budget) {
+	struct buffer_memory memory;
+	buffer_get_memory(buffer, &memory);
+	size_t slack = memory.lines_slack_bytes + memory.text_slack_bytes + memory.free_line_bytes;
+	if (slack <= slack_budget) {
+		return 0;
+	}
+	size_t size = memory.live_bytes;
+	// Half the budget is kept as room for new lines, so the next lines typed don't copy the whole array.
+	if (buffer->last_free_line_index != BUFFER_NONE || memory.lines_slack_bytes > slack_budget/2) {
+		compact_lines(buffer, min(slack_budget/2/sizeof *buffer->lines, UINT32_MAX));
+		buffer_get_memory(buffer, &memory);
+		slack = memory.lines_slack_bytes + memory.text_slack_bytes;
+	}
+	size_t reclaimed = size - memory.live_bytes;
+	for (uint32_t line_index = buffer->first_line_index; line_index != BUFFER_NONE && slack > slack_budget; line_index = buffer->lines[line_index].next_index) {
+		char8 **text = &buffer->lines[line_index].text;
+		size_t text_size = list_get_allocated_size(text);
+		size_t text_slack = list_get_capacity(text) - list_get_count(text);
+		if (text_slack && list_set_capacity(text, list_get_count(text))) {
+			reclaimed += text_size - list_get_allocated_size(text);
+			slack -= text_slack;
+		}
+	}
+	return reclaimed;
+}
+
+uint32_t buffer_get_line_index(struct buffer *buffer, uint32_t y) {
+	if (y >= buffer->line_count) {
+		return BUFFER_NONE;
+	}
+	// Walk from whichever known line is closest: the first, the last, or the one looked up last.
+	uint32_t line_index = buffer->first_line_index;
+	uint32_t from_y = 0;
+	uint32_t distance = y;
+	if (buffer->line_count - 1 - y < distance) {
+		line_index = buffer->last_line_index;
+		from_y = buffer->line_count - 1;
+		distance = from_y - y;
+	}
+	if (buffer->cached_y != BUFFER_NONE) {
+		uint32_t cached_distance = buffer->cached_y > y ? buffer->cached_y - y : y - buffer->cached_y;
+		if (cached_distance < distance) {
+			line_index = buffer->cached_line_index;
+			from_y = buffer->cached_y;
+		}
+	}
+	for (; from_y < y; ++from_y) {
+		line_index = buffer->lines[line_index].next_index;
+	}
+	for (; from_y > y; --from_y) {
+		line_index = buffer->lines[line_index].previous_index;
+	}
+	buffer->cached_y = y;
+	buffer->cached_line_index = line_index;
+	return line_index;
+}
+
+uint32_t buffer_insert_line(struct buffer *buffer, uint32_t previous_index) {
+	uint32_t line_index = buffer->last_free_line_index;
+	if (line_index != BUFFER_NONE) {
+		buffer->last_free_line_index = buffer->lines[line_index].previous_index;
+	} else {
+		struct line new_line;
+		if (!line_initialize(&new_line, initial_line_capacity)) {
+			return BUFFER_NONE;
+		}
+		line_index = list_get_count(&buffer->lines);
+		if (!list_push_back(&buffer->lines, &new_line)) {
+			line_destroy(&new_line);
+			return BUFFER_NONE;
+		}
+	}
+
+	struct line *line = buffer->lines + line_index;
+	line->previous_index = previous_index;
+	if (previous_index == BUFFER_NONE) {
+		line->next_index = buffer->first_line_index;
+		buffer->first_line_index = line_index;
+	} else {
+		line->next_index = buffer->lines[previous_index].next_index;
+		buffer->lines[previous_index].next_index = line_index;
+	}
+	if (line->next_index == BUFFER_NONE) {
+		buffer->last_line_index = line_index;
+	} else {
+		buffer->lines[line->next_index].previous_index = line_index;
+	}
+	++buffer->line_count;
+	buffer->cached_y = BUFFER_NONE;
+	return line_index;
+}
+
+void buffer_remove_line(struct buffer *buffer, uint32_t line_index) {
+	if (buffer->line_count <= 1) {
+		return;
+	}
+	struct line *line = buffer->lines + line_index;
+	if (line->previous_index == BUFFER_NONE) {
+		buffer->first_line_index = line->next_index;
+	} else {
+		buffer->lines[line->previous_index].next_index = line->next_index;
+	}
+	if (line->next_index == BUFFER_NONE) {
+		buffer->last_line_index = line->previous_index;
+	} else {
+		buffer->lines[line->next_index].previous_index = line->previous_index;
+	}
+	// Free lines keep their text allocation so it can be reused.
+	line_set_text(line, NULL, 0);
+	line->next_index = BUFFER_NONE;
+	line->previous_index = buffer->last_free_line_index;
+	buffer->last_free_line_index = line_index;
+	--buffer->line_count;
+	buffer->cached_y = BUFFER_NONE;
+}
+
+bool buffer_insert_text(struct buffer *buffer, struct mark mark, char8 *text, uint32_t length, struct mark *end) {
+	uint32_t line_index = buffer_get_line_index(buffer, mark.y);
+	if (line_index == BUFFER_NONE) {
+		return false;
+	}
+	mark.x = min(mark.x, line_get_length(buffer->lines + line_index));
+	buffer->is_modified = true;
+	struct mark insert_end = {.x = mark.x + length, .y = mark.y};
+	char8 *newline = memchr(text, '\n', length);
+	if (!newline) {
+		if (!line_insert_text(buffer->lines + line_index, mark.x, text, length)) {
+			return false;
+		}
+	} else {
+		// Move the rest of the line onto a new line, which will end up after the inserted text.
+		struct line *line = buffer->lines + line_index;
+		uint32_t tail_length = line_get_length(line) - mark.x;
+		uint32_t last_index = buffer_insert_line(buffer, line_index);
+		if (last_index == BUFFER_NONE || !line_set_text(buffer->lines + last_index, buffer->lines[line_index].text + mark.x, tail_length)) {
+			return false;
+		}
+		line = buffer->lines + line_index;
+		line_delete_text(line, mark.x, tail_length);
+		if (!line_append_text(line, text, newline - text)) {
+			return false;
+		}
+
+		// Every segment between two newlines gets its own line.
+		uint32_t previous_index = line_index;
+		char8 *segment = newline + 1;
+		char8 *text_end = text + length;
+		insert_end.y = mark.y + 1;
+		while ((newline = memchr(segment, '\n', text_end - segment))) {
+			previous_index = buffer_insert_line(buffer, previous_index);
+			if (previous_index == BUFFER_NONE || !line_set_text(buffer->lines + previous_index, segment, newline - segment)) {
+				return false;
+			}
+			segment = newline + 1;
+			++insert_end.y;
+		}
+		if (!line_insert_text(buffer->lines + last_index, 0, segment, text_end - segment)) {
+			return false;
+		}
+		insert_end.x = text_end - segment;
+		buffer->cached_y = insert_end.y;
+		buffer->cached_line_index = last_index;
+	}
+	if (end) {
+		*end = insert_end;
+	}
+	if (buffer->journal) {
+		return journal_record_insert(buffer->journal, mark, text, length);
+	}
+	return true;
+}
+
+bool buffer_delete_text(struct buffer *buffer, struct selection selection) {
+	struct mark start = selection.start;
+	struct mark end = selection.end;
+	if (end.y < start.y || (end.y == start.y && end.x < start.x)) {
+		start = selection.end;
+		end = selection.start;
+	}
+	if (end.y >= buffer->line_count) {
+		end.y = buffer->line_count - 1;
+		end.x = UINT32_MAX;
+	}
+	uint32_t start_index = buffer_get_line_index(buffer, start.y);
+	if (start_index == BUFFER_NONE) {
+		return false;
+	}
+	struct line *start_line = buffer->lines + start_index;
+	start.x = min(start.x, line_get_length(start_line));
+	buffer->is_modified = true;
+
+	if (start.y == end.y) {
+		end.x = max(start.x, min(end.x, line_get_length(start_line)));
+		line_delete_text(start_line, start.x, end.x - start.x);
+	} else {
+		uint32_t end_index = start_index;
+		for (uint32_t y = start.y; y < end.y; ++y) {
+			end_index = buffer->lines[end_index].next_index;
+		}
+		struct line *end_line = buffer->lines + end_index;
+		end.x = min(end.x, line_get_length(end_line));
+		line_delete_text(start_line, start.x, line_get_length(start_line) - start.x);
+		if (!line_append_text(start_line, end_line->text + end.x, line_get_length(end_line) - end.x)) {
+			return false;
+		}
+		for (uint32_t y = start.y; y < end.y; ++y) {
+			buffer_remove_line(buffer, buffer->lines[start_index].next_index);
+		}
+		buffer->cached_y = start.y;
+		buffer->cached_line_index = start_index;
+	}
+	if (buffer->journal) {
+		return journal_record_delete(buffer->journal, (struct selection){.start = start, .end = end});
+	}
+	return true;
+}
+
+bool buffer_load_file(struct buffer *buffer, char *file_path) {
+	int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat status;
+	if (fstat(fd, &status) != 0 || !set_file_path(buffer, file_path)) {
+		close(fd);
+		return false;
+	}
+
+	// Loading is a splice over the whole buffer, which reuses the lines already allocated.
+	char8 *text = empty_text;
+	if (status.st_size) {
+		text = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (text == MAP_FAILED) {
+			close(fd);
+			return false;
+		}
+		madvise(text, status.st_size, MADV_SEQUENTIAL);
+	}
+	uint32_t segment_count = 1;
+	for (char8 *newline = text; (newline = memchr(newline, '\n', text + status.st_size - newline)); ++newline) {
+		++segment_count;
+	}
+	bool succeeded = splice_lines(buffer, BUFFER_NONE, buffer->line_count, text, status.st_size, segment_count);
+	if (status.st_size) {
+		munmap(text, status.st_size);
+	}
+	close(fd);
+	buffer->file_size = status.st_size;
+	buffer->file_inode = status.st_ino;
+	buffer->is_modified = false;
+	return succeeded;
+}
+
+bool buffer_reload_file(struct buffer *buffer, struct line_change *change) {
+	*change = (struct line_change){0};
+	if (buffer->is_modified) {
+		return false;
+	}
+	int fd = open(buffer->file_path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat status;
+	if (fstat(fd, &status) != 0) {
+		close(fd);
+		return false;
+	}
+	bool succeeded = true;
+	if (file_only_grew(buffer, fd, &status)) {
+		succeeded = append_file_tail(buffer, fd, status.st_size, change);
+	} else {
+		succeeded = splice_file(buffer, fd, &status, change);
+	}
+	close(fd);
+	// Reloading isn't an edit. The journal's header has to describe the new file, or recovering from it
+	// would be refused.
+	if (succeeded && buffer->journal && (change->removed_count || change->inserted_count)) {
+		succeeded = journal_reset(buffer->journal);
+	}
+	return succeeded;
+}
+
+// Copies the lines into `text`, joined by newlines. `text` must have room for the whole text.
+// Returns the size of the text.
+static size_t copy_text(struct buffer *buffer, char8 *text) {
+	char8 *end = text;
+	for (uint32_t line_index = buffer->first_line_index; line_index != BUFFER_NONE; line_index = buffer->lines[line_index].next_index) {
+		struct line *line = buffer->lines + line_index;
+		memcpy(end, line->text, line_get_length(line));
+		end += line_get_length(line);
+		if (line->next_index != BUFFER_NONE) {
+			*end++ = '\n';
+		}
+	}
+	return end - text;
+}
+
+// Returns the size of the buffer's text, counting the newlines between lines.
+static size_t get_text_size(struct buffer *buffer) {
+	size_t size = buffer->line_count - 1;
+	for (uint32_t line_index = buffer->first_line_index; line_index != BUFFER_NONE; line_index = buffer->lines[line_index].next_index) {
+		size += line_get_length(buffer->lines + line_index);
+	}
+	return size;
+}
+
+bool buffer_journal_text(struct buffer *buffer, struct mark replaced_end) {
+	char8 *text = list_create(max(1, get_text_size(buffer)), sizeof *text);
+	if (!text) {
+		return false;
+	}
+	size_t size = copy_text(buffer, text);
+	bool succeeded = journal_record_delete(buffer->journal, (struct selection){.end = replaced_end})
+		&& journal_record_insert(buffer->journal, (struct mark){0}, text, size);
+	list_destroy(&text);
+	return succeeded;
+}
+
+bool buffer_begin_save(struct buffer *buffer, struct buffer_save *save) {
+	*save = (struct buffer_save){0};
+	size_t path_size = list_get_count(&buffer->file_path);
+	save->file_path = list_create(path_size, sizeof *save->file_path);
+	if (!save->file_path) {
+		goto error1;
+	}
+	memcpy(save->file_path, buffer->file_path, path_size);
+	list_set_count(&save->file_path, path_size);
+	save->text = list_create(max(1, get_text_size(buffer)), sizeof *save->text);
+	if (!save->text) {
+		goto error2;
+	}
+	list_set_count(&save->text, copy_text(buffer, save->text));
+	uint32_t last_length = line_get_length(buffer->lines + buffer->last_line_index);
+	save->end = (struct mark){last_length, buffer->line_count - 1};
+	// Edits made while the file is written set this again.
+	save->was_modified = buffer->is_modified;
+	buffer->is_modified = false;
+	return true;
+
+error2:
+	list_destroy(&save->file_path);
+error1:
+	*save = (struct buffer_save){0};
+	return false;
+}
+
+void buffer_write_save(struct buffer_save *save) {
+	// Renaming over a symbolic link would replace the link, so the file it points to is written instead.
+	// A file that doesn't exist yet is written where it was asked for.
+	char target_path[PATH_MAX];
+	if (!realpath(save->file_path, target_path)) {
+		if (errno != ENOENT || strlen(save->file_path) >= sizeof target_path) {
+			return;
+		}
+		strcpy(target_path, save->file_path);
+	}
+	char temporary_path[PATH_MAX];
+	if (snprintf(temporary_path, sizeof temporary_path, "%s.saving", target_path) >= (int)sizeof temporary_path) {
+		return;
+	}
+	struct stat status;
+	mode_t mode = stat(target_path, &status) == 0 ? status.st_mode & 07777 : 0644;
+	int fd = open(temporary_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+	if (fd < 0) {
+		return;
+	}
+	if (!write_all(fd, save->text, list_get_count(&save->text)) || fsync(fd) != 0 || fstat(fd, &status) != 0) {
+		close(fd);
+		unlink(temporary_path);
+		return;
+	}
+	close(fd);
+	if (rename(temporary_path, target_path) != 0) {
+		unlink(temporary_path);
+		return;
+	}
+	save->file_size = status.st_size;
+	save->file_inode = status.st_ino;
+	save->is_replaced = true;
+	// The file is only replaced for good once the directory's entry for it is on disk.
+	save->succeeded = sync_parent_directory(target_path);
+}
+
+bool buffer_end_save(struct buffer *buffer, struct buffer_save *save) {
+	bool succeeded = save->succeeded;
+	if (save->is_replaced) {
+		buffer->file_size = save->file_size;
+		buffer->file_inode = save->file_inode;
+	}
+	if (!succeeded) {
+		buffer->is_modified = buffer->is_modified || save->was_modified;
+	} else if (buffer->journal) {
+		// The saved file has every edit made before the save began, so the journal starts over from it.
+		// Edits made since then are journaled again on top of the saved text.
+		succeeded = journal_reset(buffer->journal) && (!buffer->is_modified || buffer_journal_text(buffer, save->end));
+	}
+	list_destroy(&save->text);
+	list_destroy(&save->file_path);
+	*save = (struct buffer_save){0};
+	return succeeded;
+}
+
+bool buffer_save_file(struct buffer *buffer) {
+	struct buffer_save save;
+	if (!buffer_begin_save(buffer, &save)) {
+		return false;
+	}
+	buffer_write_save(&save);
+	return buffer_end_save(buffer, &save);
+}
+
+bool buffer_view_initialize(struct buffer_view *view, struct buffer *buffer, uint32_t page_width, uint32_t page_height) {
+	*view = (struct buffer_view){
+		.buffer = buffer,
+		.page_width = page_width,
+		.page_height = page_height,
+	};
+	view->selections = list_create(initial_selections_capacity, sizeof *view->selections);
+	if (!view->selections) {
+		goto error1;
+	}
+	view->matches = list_create(initial_matches_capacity, sizeof *view->matches);
+	if (!view->matches) {
+		goto error2;
+	}
+	struct selection selection = {0};
+	list_push_back(&view->selections, &selection);
+	return true;
+
+error2:
+	list_destroy(&view->selections);
+error1:
+	*view = (struct buffer_view){0};
+	return false;
+}
+
+void buffer_view_destroy(struct buffer_view *view) {
+	list_destroy(&view->matches);
+	list_destroy(&view->selections);
+	*view = (struct buffer_view){0};
+}
+
+void buffer_view_apply_line_change(struct buffer_view *view, struct line_change *change) {
+	struct buffer *buffer = view->buffer;
+	if (change->removed_count == 0 && change->inserted_count == 0) {
+		return;
+	}
+	for (size_t i = 0; i < list_get_count(&view->selections); ++i) {
+		remap_mark(buffer, change, &view->selections[i].start);
+		remap_mark(buffer, change, &view->selections[i].end);
+	}
+
+	// Matches on replaced lines are stale, so they're dropped rather than moved.
+	size_t kept_count = 0;
+	for (size_t i = 0; i < list_get_count(&view->matches); ++i) {
+		struct selection match = view->matches[i];
+		bool starts_after = match.start.y >= change->y + change->removed_count;
+		if (match.end.y < change->y || starts_after) {
+			if (starts_after) {
+				match.start.y = match.start.y - change->removed_count + change->inserted_count;
+				match.end.y = match.end.y - change->removed_count + change->inserted_count;
+			}
+			if (i == view->current_match_index) {
+				view->current_match_index = kept_count;
+			}
+			view->matches[kept_count++] = match;
+		}
+	}
+	list_set_count(&view->matches, kept_count);
+	if (view->current_match_index >= kept_count) {
+		view->current_match_index = 0;
+	}
+
+	if (view->scroll_y >= change->y + change->removed_count) {
+		view->scroll_y = view->scroll_y - change->removed_count + change->inserted_count;
+	} else if (view->scroll_y >= change->y && view->scroll_y - change->y >= change->inserted_count) {
+		view->scroll_y = min(change->y + change->inserted_count, buffer->line_count - 1);
+	}
+}
+
+bool buffer_view_find(struct buffer_view *view, char8 *pattern, uint32_t length) {
+	struct buffer *buffer = view->buffer;
+	struct mark cursor = view->selections[view->current_selection_index].end;
+	list_set_count(&view->matches, 0);
+	view->current_match_index = 0;
+	if (length == 0) {
+		return true;
+	}
+	bool is_current_found = false;
+	uint32_t y = 0;
+	for (uint32_t line_index = buffer->first_line_index; line_index != BUFFER_NONE; line_index = buffer->lines[line_index].next_index, ++y) {
+		struct line *line = buffer->lines + line_index;
+		char8 *text = line->text;
+		char8 *end = text + line_get_length(line);
+		char8 *found;
+		while ((found = memmem(text, end - text, pattern, length))) {
+			uint32_t x = found - line->text;
+			struct selection match = {.start = {x, y}, .end = {x + length, y}};
+			if (!is_current_found && (y > cursor.y || (y == cursor.y && x >= cursor.x))) {
+				view->current_match_index = list_get_count(&view->matches);
+				is_current_found = true;
+			}
+			if (!list_push_back(&view->matches, &match)) {
+				return false;
+			}
+			text = found + length;
+		}
+	}
+	return true;
+}
+
 bool line_initialize(struct line *line, uint32_t capacity) {
-	line->text = list_create(capacity, sizeof *line->text);
+	line->text = list_create(max(1, capacity), sizeof *line->text);
 	if (!line->text) {
 		*line = (struct line){0};
 		return false;
 	}
+	line->text[0] = '\0';
+	list_set_count(&line->text, 1);
+	line->hash = 0;
 	line->previous_index = BUFFER_NONE;
 	line->next_index = BUFFER_NONE;
 	return true;
@@ -56,3 +965,101 @@ void line_destroy(struct line *line) {
 	list_destroy(&line->text);
 	*line = (struct line){0};
 }
+
+uint32_t line_get_length(struct line *line) {
+	return list_get_count(&line->text) - 1; // Subtracting 1 for the null terminator.
+}
+
+uint64_t line_get_hash(struct line *line) {
+	if (!line->hash) {
+		line->hash = line_hash_text(line->text, line_get_length(line));
+	}
+	return line->hash;
+}
+
+uint64_t line_hash_text(char8 *text, size_t length) {
+	// Reads a word at a time, with four independent lanes so the multiplies can overlap.
+	uint64_t lanes[4] = {0x243f6a8885a308d3, 0x13198a2e03707344, 0xa4093822299f31d0, 0x082efa98ec4e6c89};
+	size_t i = 0;
+	for (; i + 32 <= length; i += 32) {
+		for (size_t j = 0; j < 4; ++j) {
+			uint64_t word;
+			memcpy(&word, text + i + 8*j, sizeof word);
+			lanes[j] = (lanes[j] ^ word)*hash_multiplier;
+			lanes[j] ^= lanes[j] >> 29;
+		}
+	}
+	uint64_t hash = lanes[0] ^ (lanes[1] << 1) ^ (lanes[2] << 2) ^ (lanes[3] << 3) ^ length;
+	for (; i + 8 <= length; i += 8) {
+		uint64_t word;
+		memcpy(&word, text + i, sizeof word);
+		hash = (hash ^ word)*hash_multiplier;
+		hash ^= hash >> 29;
+	}
+	uint64_t tail = 0;
+	memcpy(&tail, text + i, length - i);
+	hash = (hash ^ tail)*hash_multiplier;
+	// Mixes the high bits into the low ones, so every input bit affects every output bit.
+	hash ^= hash >> 32;
+	hash *= hash_multiplier;
+	hash ^= hash >> 29;
+	return hash ? hash : 1;
+}
+
+bool line_set_text(struct line *line, char8 *text, uint32_t length) {
+	line->hash = 0;
+	if (length + 1 > list_get_capacity(&line->text) && !list_set_capacity(&line->text, length + 1)) {
+		return false;
+	}
+	if (length) {
+		memcpy(line->text, text, length);
+	}
+	line->text[length] = '\0';
+	list_set_count(&line->text, length + 1);
+	return true;
+}
+
+bool line_append_text(struct line *line, char8 *text, uint32_t length) {
+	line->hash = 0;
+	uint32_t old_length = line_get_length(line);
+	size_t capacity = list_get_capacity(&line->text);
+	if (old_length + length + 1 > capacity) {
+		size_t new_capacity = max(old_length + length + 1, list_growth_factor*capacity);
+		if (!list_set_capacity(&line->text, new_capacity)) {
+			return false;
+		}
+	}
+	memcpy(line->text + old_length, text, length);
+	line->text[old_length + length] = '\0';
+	list_set_count(&line->text, old_length + length + 1);
+	return true;
+}
+
+bool line_insert_text(struct line *line, uint32_t x, char8 *text, uint32_t length) {
+	line->hash = 0;
+	uint32_t old_length = line_get_length(line);
+	size_t capacity = list_get_capacity(&line->text);
+	if (old_length + length + 1 > capacity) {
+		size_t new_capacity = max(old_length + length + 1, list_growth_factor*capacity);
+		if (!list_set_capacity(&line->text, new_capacity)) {
+			return false;
+		}
+	}
+	x = min(x, old_length);
+	memmove(line->text + x + length, line->text + x, old_length - x + 1); // Adding 1 to move the null terminator.
+	memcpy(line->text + x, text, length);
+	list_set_count(&line->text, old_length + length + 1);
+	return true;
+}
+
+void line_delete_text(struct line *line, uint32_t x, uint32_t length) {
+	line->hash = 0;
+	uint32_t old_length = line_get_length(line);
+	x = min(x, old_length);
+	length = min(length, old_length - x);
+	memmove(line->text + x, line->text + x + length, old_length - x - length + 1); // Adding 1 to move the null terminator.
+	list_set_count(&line->text, old_length - length + 1);
+}
+
+#undef min
+#undef max
@@ -1,9 +1,12 @@
 #ifndef BUFFER_H
+#define BUFFER_H
 
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 
+struct journal;
+
 // Sentinel value used in `buffer` to indicate a line index is invalid.
 #define BUFFER_NONE UINT32_MAX
 
@@ -29,6 +32,7 @@ struct line {
 	uint32_t previous_index;
 	uint32_t next_index;
 	char8 *text; // Points to a list. Doesn't end with a newline. Null terminated.
+	uint64_t hash; // Cached by `line_get_hash`. 0 if the text changed since.
 };
 
 // A piece of text being edited. Can be edited by multiple `buffer_view`s at once.
@@ -37,7 +41,34 @@ struct buffer {
 	struct line *lines; // Points to a list.
 	uint32_t first_line_index;
 	uint32_t last_line_index;
-	uint32_t last_free_line_index;
+	uint32_t last_free_line_index; // Free lines are chained through `previous_index`.
+	uint32_t line_count; // Not counting free lines. Always at least 1.
+	uint64_t file_size; // Size of the file when it was last read.
+	uint64_t file_inode; // Inode of the file when it was last read. Changes if the file is replaced.
+	struct journal *journal; // May be NULL. Records every edit made with `buffer_insert_text` and `buffer_delete_text`.
+	bool is_modified; // Set by every edit. Cleared when the buffer is loaded from or saved to its file.
+	uint32_t cached_y; // The row of the line last looked up, or BUFFER_NONE. Speeds up nearby lookups.
+	uint32_t cached_line_index;
+};
+
+// A save in progress. The text is copied when the save begins, so the file can be written on another
+// thread while the buffer keeps being edited.
+struct buffer_save {
+	char *file_path; // Points to a list. Null terminated.
+	char8 *text; // Points to a list.
+	struct mark end; // The end of the copied text.
+	uint64_t file_size; // The saved file's size and inode, once it has replaced the old file.
+	uint64_t file_inode;
+	bool was_modified; // Restored if the save fails.
+	bool is_replaced; // Set once the saved file has the buffer's path, even if it isn't durable yet.
+	bool succeeded;
+};
+
+// Describes lines that were replaced in a buffer. Used to keep `buffer_view`s in place.
+struct line_change {
+	uint32_t y; // The first line replaced.
+	uint32_t removed_count;
+	uint32_t inserted_count;
 };
 
 // Used to edit a buffer with selections.
@@ -53,12 +84,121 @@ struct buffer_view {
 	uint32_t page_height;
 };
 
+// Where a buffer's memory goes. Slack is memory allocated but not holding text or lines.
+struct buffer_memory {
+	size_t live_bytes; // Every byte allocated for the buffer, including slack.
+	size_t lines_slack_bytes; // Unused capacity in `buffer.lines`.
+	size_t text_slack_bytes; // Unused capacity in the text of lines in use.
+	size_t free_line_bytes; // Line slots on the free chain and their text.
+	uint32_t line_slot_count; // Lines in use and free.
+	uint32_t free_line_count;
+	uint32_t allocation_count;
+};
+
 bool buffer_initialize(struct buffer *buffer, uint32_t lines_capacity, uint32_t line_character_capaity);
 
 void buffer_destroy(struct buffer *buffer);
 
+void buffer_get_memory(struct buffer *buffer, struct buffer_memory *memory);
+
+// Returns the unused line slots, free or never used, in bytes. Doesn't walk the lines, so it's cheap
+// enough to check whether trimming is worth it.
+size_t buffer_get_line_slack_bytes(struct buffer *buffer);
+
+// Gives memory the buffer isn't using back to the allocator until at most `slack_budget` bytes of
+// slack are left. Free lines are released first by moving the lines after them into their slots,
+// keeping room for half the budget's worth of new lines. Then line text is shrunk. Line indices may
+// change, rows don't. Returns the number of bytes reclaimed.
+size_t buffer_trim(struct buffer *buffer, size_t slack_budget);
+
+// Returns the index in `buffer->lines` of the line at row `y`, or BUFFER_NONE if there isn't one.
+uint32_t buffer_get_line_index(struct buffer *buffer, uint32_t y);
+
+// Inserts an empty line after the line at `previous_index`, or at the start if `previous_index` is
+// BUFFER_NONE. Reuses a free line if there is one. Returns the new line's index, or BUFFER_NONE if
+// memory error.
+uint32_t buffer_insert_line(struct buffer *buffer, uint32_t previous_index);
+
+// Unlinks the line and puts it on the free chain. Does nothing if it's the only line.
+void buffer_remove_line(struct buffer *buffer, uint32_t line_index);
+
+// Inserts `text` at `mark`. The text may contain newlines. The position after the inserted text is
+// stored in `end` if it isn't NULL. Returns false if memory error.
+bool buffer_insert_text(struct buffer *buffer, struct mark mark, char8 *text, uint32_t length, struct mark *end);
+
+// Deletes the selected text, joining lines if it spans more than one. Returns false if memory error.
+bool buffer_delete_text(struct buffer *buffer, struct selection selection);
+
+// Replaces the buffer's text with the file's. Returns false if memory or IO error.
+bool buffer_load_file(struct buffer *buffer, char *file_path);
+
+// Brings the buffer up to date with its file on disk, replacing only the lines that changed. If the
+// file only grew, only the new bytes are read. The replaced lines are described by `change`. The
+// journal starts over from the new file. Does nothing and returns false if the buffer has unsaved
+// edits, since they'd be lost. Returns false if memory or IO error.
+bool buffer_reload_file(struct buffer *buffer, struct line_change *change);
+
+// Writes the buffer to its file. The text goes to a temporary file first, which then replaces the
+// file, so a crash never leaves it half written. If the file is a symbolic link, the file it points to
+// is replaced and the link is kept. The journal only starts over once the new file is on disk.
+// Returns false if IO error.
+bool buffer_save_file(struct buffer *buffer);
+
+// Starts saving the buffer the way `buffer_save_file` does, by copying its text. Returns false if
+// memory error.
+bool buffer_begin_save(struct buffer *buffer, struct buffer_save *save);
+
+// Writes the copied text to the file. Only touches `save`, so it can run on any thread.
+void buffer_write_save(struct buffer_save *save);
+
+// Finishes a save on the buffer's thread and destroys `save`. The journal starts over from the saved
+// file, with any edits made during the save journaled again. Returns false if the save or the journal
+// failed, in which case the buffer stays modified.
+bool buffer_end_save(struct buffer *buffer, struct buffer_save *save);
+
+// Journals the buffer's whole text as one replacement of the text from the start of its file to
+// `replaced_end`. Used when the journal starts over from a file that doesn't have all of the buffer's
+// edits. Returns false if memory error.
+bool buffer_journal_text(struct buffer *buffer, struct mark replaced_end);
+
+bool buffer_view_initialize(struct buffer_view *view, struct buffer *buffer, uint32_t page_width, uint32_t page_height);
+
+void buffer_view_destroy(struct buffer_view *view);
+
+// Moves the view's selections, matches, and scroll position to account for lines being replaced in
+// its buffer.
+void buffer_view_apply_line_change(struct buffer_view *view, struct line_change *change);
+
+// Replaces the view's matches with every occurrence of `pattern` in its buffer. Matches don't span
+// lines or overlap. The current match is the first one at or after the cursor, wrapping to the
+// first. Returns false if memory error.
+bool buffer_view_find(struct buffer_view *view, char8 *pattern, uint32_t length);
+
 bool line_initialize(struct line *line, uint32_t capacity);
 
 void line_destroy(struct line *line);
 
+// Returns the number of characters in the line, not counting the null terminator.
+uint32_t line_get_length(struct line *line);
+
+// Returns the hash of the line's text, computing it only if the text changed since the last call. Never
+// returns 0.
+uint64_t line_get_hash(struct line *line);
+
+// Hashes text the same way as `line_get_hash`, so lines can be compared with text that isn't in a
+// buffer.
+uint64_t line_hash_text(char8 *text, size_t length);
+
+// Returns false if memory error.
+bool line_set_text(struct line *line, char8 *text, uint32_t length);
+
+// Returns false if memory error.
+bool line_append_text(struct line *line, char8 *text, uint32_t length);
+
+// Inserts text before the character at `x`. Returns false if memory error.
+bool line_insert_text(struct line *line, uint32_t x, char8 *text, uint32_t length);
+
+// Deletes `length` characters starting at `x`.
+void line_delete_text(struct line *line, uint32_t x, uint32_t length);
+
 #endif // BUFFER_H
@@ -0,0 +1,379 @@
+#define MEMORY_SUBSYSTEM MEMORY_SUBSYSTEM_DIFF
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "diff.h"
+#include "buffer.h"
+#include "list.h"
+
+#define min(a, b) (((a) <= (b)) ? (a) : (b))
+#define max(a, b) (((a) >= (b)) ? (a) : (b))
+
+// Where an optimal path through a range crosses its middle diagonally. Relative to the range.
+struct snake {
+	int32_t x;
+	int32_t y;
+	int32_t end_x;
+	int32_t end_y;
+};
+
+static const size_t initial_hashes_capacity = 1024;
+
+static const size_t initial_pending_capacity = 64;
+
+static const size_t initial_hunks_capacity = 64;
+
+// Keeps pathological diffs, like two unrelated files, from taking quadratic time.
+static const uint32_t default_max_cost = 256;
+
+static char8 empty_text[1];
+
+// Returns false if memory error.
+static bool hash_buffer(uint64_t **hashes, struct buffer *buffer) {
+	if (buffer->line_count > list_get_capacity(hashes) && !list_set_capacity(hashes, buffer->line_count)) {
+		return false;
+	}
+	uint32_t y = 0;
+	for (uint32_t line_index = buffer->first_line_index; line_index != BUFFER_NONE; line_index = buffer->lines[line_index].next_index) {
+		(*hashes)[y++] = line_get_hash(buffer->lines + line_index);
+	}
+	list_set_count(hashes, y);
+	return true;
+}
+
+// Returns true if the range overlaps the rows of the new text from `y` to `y + count`. Ranges that
+// only delete lines touch the row they'd be deleted before.
+static bool range_overlaps(struct diff_range *range, uint32_t y, uint32_t count) {
+	return range->new_begin <= y + count && range->new_end >= y;
+}
+
+// Returns false if memory error.
+static bool push_range(struct diff *diff, uint32_t old_begin, uint32_t old_end, uint32_t new_begin, uint32_t new_end) {
+	if (old_begin == old_end && new_begin == new_end) {
+		return true;
+	}
+	struct diff_range range = {old_begin, old_end, new_begin, new_end};
+	return list_push_back(&diff->pending, &range) != NULL;
+}
+
+// Finds the middle snake of the range with Myers' linear space algorithm: the forward and backward
+// searches meet on it after about half the edits each. Gives up after `diff.max_cost` edits and returns
+// the furthest point the forward search reached, which splits the range well enough. Adds the
+// comparisons made to `work`.
+static void find_middle_snake(struct diff *diff, uint64_t *a, int32_t n, uint64_t *b, int32_t m, struct snake *snake, uint64_t *work) {
+	int32_t limit = min((n + m + 1)/2, (int32_t)diff->max_cost);
+	// Diagonal k holds the points where x - y == k. Only the diagonals inside the range are searched.
+	int32_t *forward = diff->forward + limit + 1;
+	int32_t *backward = diff->backward + limit + 1;
+	int32_t delta = n - m;
+	bool is_odd = delta & 1;
+	forward[1] = 0;
+	backward[1] = 0;
+	for (int32_t d = 0; d <= limit; ++d) {
+		int32_t low_k = max(-d, -m + ((d + m)&1));
+		int32_t high_k = min(d, n - ((d + n)&1));
+		for (int32_t k = low_k; k <= high_k; k += 2) {
+			// Only step from diagonals that were searched last time.
+			bool can_go_down = k != d && k + 1 <= n;
+			bool can_go_right = k != -d && k - 1 >= -m;
+			bool is_down = !can_go_right || (can_go_down && forward[k - 1] < forward[k + 1]);
+			int32_t x = min(is_down ? forward[k + 1] : forward[k - 1] + 1, min(n, m + k));
+			int32_t y = x - k;
+			int32_t start_x = x;
+			while (x < n && y < m && a[x] == b[y]) {
+				++x;
+				++y;
+			}
+			*work += x - start_x + 1;
+			forward[k] = x;
+			int32_t backward_k = delta - k;
+			if (is_odd && backward_k >= -(d - 1) && backward_k <= d - 1 && x + backward[backward_k] >= n) {
+				*snake = (struct snake){start_x, start_x - k, x, y};
+				return;
+			}
+		}
+		// Searching backward is searching forward through both sequences reversed.
+		for (int32_t k = low_k; k <= high_k; k += 2) {
+			bool can_go_down = k != d && k + 1 <= n;
+			bool can_go_right = k != -d && k - 1 >= -m;
+			bool is_down = !can_go_right || (can_go_down && backward[k - 1] < backward[k + 1]);
+			int32_t x = min(is_down ? backward[k + 1] : backward[k - 1] + 1, min(n, m + k));
+			int32_t y = x - k;
+			int32_t start_x = x;
+			while (x < n && y < m && a[n - 1 - x] == b[m - 1 - y]) {
+				++x;
+				++y;
+			}
+			*work += x - start_x + 1;
+			backward[k] = x;
+			int32_t forward_k = delta - k;
+			if (!is_odd && forward_k >= -d && forward_k <= d && x + forward[forward_k] >= n) {
+				*snake = (struct snake){n - x, m - y, n - start_x, m - (start_x - k)};
+				return;
+			}
+		}
+	}
+
+	int32_t best_x = 0;
+	int32_t best_y = 0;
+	int32_t low_k = max(-limit, -m + ((limit + m)&1));
+	int32_t high_k = min(limit, n - ((limit + n)&1));
+	for (int32_t k = low_k; k <= high_k; k += 2) {
+		int32_t x = forward[k];
+		if (x + x - k > best_x + best_y) {
+			best_x = x;
+			best_y = x - k;
+		}
+	}
+	*snake = (struct snake){best_x, best_y, best_x, best_y};
+}
+
+// Returns the index in `diff.pending` of the range to diff next: one on the focused rows if there is
+// one, otherwise the one nearest the start.
+static size_t pick_range(struct diff *diff) {
+	size_t count = list_get_count(&diff->pending);
+	if (diff->focus_count) {
+		for (size_t i = count; i > 0; --i) {
+			if (range_overlaps(diff->pending + i - 1, diff->focus_y, diff->focus_count)) {
+				return i - 1;
+			}
+		}
+	}
+	return count - 1;
+}
+
+static int compare_hunks(const void *a, const void *b) {
+	const struct diff_hunk *x = a;
+	const struct diff_hunk *y = b;
+	if (x->new_y != y->new_y) {
+		return (x->new_y > y->new_y) - (x->new_y < y->new_y);
+	}
+	return (x->old_y > y->old_y) - (x->old_y < y->old_y);
+}
+
+// Sorts the hunks and joins a deletion and an insertion in the same place into one hunk.
+static void finish(struct diff *diff) {
+	size_t count = list_get_count(&diff->hunks);
+	qsort(diff->hunks, count, sizeof *diff->hunks, compare_hunks);
+	size_t kept_count = 0;
+	for (size_t i = 0; i < count; ++i) {
+		struct diff_hunk hunk = diff->hunks[i];
+		struct diff_hunk *previous = kept_count ? diff->hunks + kept_count - 1 : NULL;
+		if (previous && previous->old_y + previous->old_count == hunk.old_y && previous->new_y + previous->new_count == hunk.new_y) {
+			previous->old_count += hunk.old_count;
+			previous->new_count += hunk.new_count;
+		} else {
+			diff->hunks[kept_count++] = hunk;
+		}
+	}
+	list_set_count(&diff->hunks, kept_count);
+	diff->is_done = true;
+}
+
+bool diff_initialize(struct diff *diff) {
+	*diff = (struct diff){.max_cost = default_max_cost, .is_done = true};
+	diff->old_hashes = list_create(initial_hashes_capacity, sizeof *diff->old_hashes);
+	if (!diff->old_hashes) {
+		goto error1;
+	}
+	diff->new_hashes = list_create(initial_hashes_capacity, sizeof *diff->new_hashes);
+	if (!diff->new_hashes) {
+		goto error2;
+	}
+	diff->pending = list_create(initial_pending_capacity, sizeof *diff->pending);
+	if (!diff->pending) {
+		goto error3;
+	}
+	diff->hunks = list_create(initial_hunks_capacity, sizeof *diff->hunks);
+	if (!diff->hunks) {
+		goto error4;
+	}
+	diff->forward = list_create(2*default_max_cost + 3, sizeof *diff->forward);
+	if (!diff->forward) {
+		goto error5;
+	}
+	diff->backward = list_create(2*default_max_cost + 3, sizeof *diff->backward);
+	if (!diff->backward) {
+		goto error6;
+	}
+	return true;
+
+error6:
+	list_destroy(&diff->forward);
+error5:
+	list_destroy(&diff->hunks);
+error4:
+	list_destroy(&diff->pending);
+error3:
+	list_destroy(&diff->new_hashes);
+error2:
+	list_destroy(&diff->old_hashes);
+error1:
+	*diff = (struct diff){0};
+	return false;
+}
+
+void diff_destroy(struct diff *diff) {
+	list_destroy(&diff->backward);
+	list_destroy(&diff->forward);
+	list_destroy(&diff->hunks);
+	list_destroy(&diff->pending);
+	list_destroy(&diff->new_hashes);
+	list_destroy(&diff->old_hashes);
+	*diff = (struct diff){0};
+}
+
+bool diff_set_old_buffer(struct diff *diff, struct buffer *buffer) {
+	return hash_buffer(&diff->old_hashes, buffer);
+}
+
+bool diff_set_old_file(struct diff *diff, char *file_path) {
+	int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat status;
+	if (fstat(fd, &status) != 0) {
+		close(fd);
+		return false;
+	}
+	char8 *data = empty_text;
+	size_t size = status.st_size;
+	if (size) {
+		data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			close(fd);
+			return false;
+		}
+		madvise(data, size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+
+	bool succeeded = true;
+	list_set_count(&diff->old_hashes, 0);
+	char8 *end = data + size;
+	for (char8 *start = data; succeeded;) {
+		char8 *newline = memchr(start, '\n', end - start);
+		uint64_t hash = line_hash_text(start, (newline ? newline : end) - start);
+		succeeded = list_push_back(&diff->old_hashes, &hash) != NULL;
+		if (!newline) {
+			break;
+		}
+		start = newline + 1;
+	}
+	if (size) {
+		munmap(data, size);
+	}
+	return succeeded;
+}
+
+bool diff_start(struct diff *diff, struct buffer *buffer) {
+	list_set_count(&diff->pending, 0);
+	list_set_count(&diff->hunks, 0);
+	diff->is_done = false;
+	if (!hash_buffer(&diff->new_hashes, buffer)) {
+		return false;
+	}
+	// Most of the text is usually the same, so the ends are matched here before any real diffing.
+	uint32_t old_end = list_get_count(&diff->old_hashes);
+	uint32_t new_end = list_get_count(&diff->new_hashes);
+	uint32_t begin = 0;
+	while (begin < old_end && begin < new_end && diff->old_hashes[begin] == diff->new_hashes[begin]) {
+		++begin;
+	}
+	while (old_end > begin && new_end > begin && diff->old_hashes[old_end - 1] == diff->new_hashes[new_end - 1]) {
+		--old_end;
+		--new_end;
+	}
+
+	size_t diagonal_count = 2*min((size_t)(old_end - begin + new_end - begin + 1)/2, diff->max_cost) + 3;
+	if (diagonal_count > list_get_capacity(&diff->forward) && !list_set_capacity(&diff->forward, diagonal_count)) {
+		return false;
+	}
+	if (diagonal_count > list_get_capacity(&diff->backward) && !list_set_capacity(&diff->backward, diagonal_count)) {
+		return false;
+	}
+	if (!push_range(diff, begin, old_end, begin, new_end)) {
+		return false;
+	}
+	if (list_is_empty(&diff->pending)) {
+		finish(diff);
+	}
+	return true;
+}
+
+void diff_set_focus(struct diff *diff, uint32_t y, uint32_t count) {
+	diff->focus_y = y;
+	diff->focus_count = count;
+}
+
+bool diff_step(struct diff *diff, uint64_t max_work) {
+	uint64_t work = 0;
+	while (list_is_not_empty(&diff->pending) && work < max_work) {
+		size_t index = pick_range(diff);
+		struct diff_range range = diff->pending[index];
+		size_t count = list_get_count(&diff->pending);
+		memmove(diff->pending + index, diff->pending + index + 1, (count - index - 1)*sizeof *diff->pending);
+		list_set_count(&diff->pending, count - 1);
+
+		uint64_t *a = diff->old_hashes;
+		uint64_t *b = diff->new_hashes;
+		while (range.old_begin < range.old_end && range.new_begin < range.new_end && a[range.old_begin] == b[range.new_begin]) {
+			++range.old_begin;
+			++range.new_begin;
+			++work;
+		}
+		while (range.old_begin < range.old_end && range.new_begin < range.new_end && a[range.old_end - 1] == b[range.new_end - 1]) {
+			--range.old_end;
+			--range.new_end;
+			++work;
+		}
+		if (range.old_begin == range.old_end || range.new_begin == range.new_end) {
+			if (range.old_begin == range.old_end && range.new_begin == range.new_end) {
+				continue;
+			}
+			struct diff_hunk hunk = {
+				.old_y = range.old_begin,
+				.old_count = range.old_end - range.old_begin,
+				.new_y = range.new_begin,
+				.new_count = range.new_end - range.new_begin,
+			};
+			if (!list_push_back(&diff->hunks, &hunk)) {
+				return false;
+			}
+			continue;
+		}
+
+		struct snake snake;
+		find_middle_snake(diff, a + range.old_begin, range.old_end - range.old_begin, b + range.new_begin, range.new_end - range.new_begin, &snake, &work);
+		// The start of the range goes on top, so without a focus the hunks are found in order.
+		if (!push_range(diff, range.old_begin + snake.end_x, range.old_end, range.new_begin + snake.end_y, range.new_end)) {
+			return false;
+		}
+		if (!push_range(diff, range.old_begin, range.old_begin + snake.x, range.new_begin, range.new_begin + snake.y)) {
+			return false;
+		}
+	}
+	if (!diff->is_done && list_is_empty(&diff->pending)) {
+		finish(diff);
+	}
+	return true;
+}
+
+bool diff_is_final(struct diff *diff, uint32_t y, uint32_t count) {
+	for (size_t i = 0; i < list_get_count(&diff->pending); ++i) {
+		if (range_overlaps(diff->pending + i, y, count)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+#undef min
+#undef max
@@ -0,0 +1,66 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "buffer.h"
+
+// Lines replaced between the old text and the new text. Either count may be 0.
+struct diff_hunk {
+	uint32_t old_y;
+	uint32_t old_count;
+	uint32_t new_y;
+	uint32_t new_count;
+};
+
+// Rows of the old and new text that haven't been diffed yet.
+struct diff_range {
+	uint32_t old_begin;
+	uint32_t old_end;
+	uint32_t new_begin;
+	uint32_t new_end;
+};
+
+// Compares two texts line by line, using each line's hash in place of its text. The diff runs in
+// steps of bounded work, so hunks can be shown as they're found. The part of the new text on screen
+// is diffed first.
+struct diff {
+	uint64_t *old_hashes; // Points to a list.
+	uint64_t *new_hashes; // Points to a list.
+	struct diff_range *pending; // Points to a list. The ranges left to diff.
+	struct diff_hunk *hunks; // Points to a list. In the order found, then sorted by row once the diff is done.
+	int32_t *forward; // Points to a list. The furthest x on each diagonal, searching from the start.
+	int32_t *backward; // Points to a list. The same, searching from the end.
+	uint32_t focus_y; // The rows of the new text that are diffed first.
+	uint32_t focus_count;
+	uint32_t max_cost; // After this many edits, a range is split at a good enough point instead of the best one.
+	bool is_done;
+};
+
+bool diff_initialize(struct diff *diff);
+
+void diff_destroy(struct diff *diff);
+
+// Uses the buffer's lines as the old text. Returns false if memory error.
+bool diff_set_old_buffer(struct diff *diff, struct buffer *buffer);
+
+// Uses the file's lines as the old text, split the same way `buffer_load_file` splits them. Only needs
+// to be called again when the file changes. Returns false if memory or IO error.
+bool diff_set_old_file(struct diff *diff, char *file_path);
+
+// Starts diffing the old text against the buffer, dropping any previous results. Lines that weren't
+// edited since the last diff aren't hashed again, and lines that match at the start and end are
+// skipped without diffing. Returns false if memory error.
+bool diff_start(struct diff *diff, struct buffer *buffer);
+
+// Makes the rows of the new text from `y` to `y + count` the next to be diffed.
+void diff_set_focus(struct diff *diff, uint32_t y, uint32_t count);
+
+// Diffs until about `max_work` comparisons are made or the diff is done. Returns false if memory error.
+bool diff_step(struct diff *diff, uint64_t max_work);
+
+// Returns true if the hunks touching the rows of the new text from `y` to `y + count` have all been
+// found.
+bool diff_is_final(struct diff *diff, uint32_t y, uint32_t count);
+
+#endif // DIFF_H
@@ -1,6 +1,621 @@
+#define _GNU_SOURCE
+#define MEMORY_SUBSYSTEM MEMORY_SUBSYSTEM_EDITOR
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <malloc.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <ncurses.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include "editor.h"
 #include "buffer.h"
+#include "journal.h"
+#include "list.h"
+#include "memory.h"
+#include "watcher.h"
 
-struct editor {
-	
-};
+#define min(a, b) (((a) <= (b)) ? (a) : (b))
+#define max(a, b) (((a) >= (b)) ? (a) : (b))
+
+// The control key clears the upper bits of the key it's pressed with.
+#define control(key) ((key) & 0x1f)
+
+// Redraws are held back so there's at most one per frame.
+static const uint64_t frame_nanoseconds = 1000000000/60;
+
+static const uint64_t blink_nanoseconds = 500*1000000;
+
+// The cursor stops blinking after this many blinks without a key, so an idle editor never wakes up.
+static const uint32_t max_blink_count = 20;
+
+// Memory is trimmed once typing has stopped for this long.
+static const uint32_t trim_delay_milliseconds = 2000;
+
+static const size_t default_trim_slack_budget = 1024*1024;
+
+static const char memory_report_name[] = "editor-memory.txt";
+
+// How long the journal waits for more edits before syncing them to disk.
+static const uint32_t journal_commit_delay_milliseconds = 50;
+
+static const uint32_t initial_lines_capacity = 1024;
+
+static const uint32_t initial_line_capacity = 16;
+
+static const size_t initial_completions_capacity = 16;
+
+static const size_t initial_message_capacity = 256;
+
+static uint64_t get_time(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (uint64_t)time.tv_sec*1000000000 + time.tv_nsec;
+}
+
+static bool watch_fd(int epoll_fd, int fd) {
+	struct epoll_event event = {.events = EPOLLIN, .data.fd = fd};
+	return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+// Starts a timer that first fires after `delay` nanoseconds, then every `interval` nanoseconds if
+// it isn't 0. A `delay` of 0 stops the timer.
+static void set_timer(int fd, uint64_t delay, uint64_t interval) {
+	struct itimerspec time = {
+		.it_value = {.tv_sec = delay/1000000000, .tv_nsec = delay%1000000000},
+		.it_interval = {.tv_sec = interval/1000000000, .tv_nsec = interval%1000000000},
+	};
+	timerfd_settime(fd, 0, &time, NULL);
+}
+
+// Empties a timerfd or eventfd so it stops being readable.
+static void read_counter(int fd) {
+	uint64_t counter = 0;
+	(void)!read(fd, &counter, sizeof counter);
+}
+
+static struct mark *get_cursor(struct editor *editor) {
+	return &editor->view.selections[editor->view.current_selection_index].end;
+}
+
+// Collapses the current selection onto the cursor.
+static void set_cursor(struct editor *editor, struct mark mark) {
+	struct selection *selection = editor->view.selections + editor->view.current_selection_index;
+	selection->start = mark;
+	selection->end = mark;
+}
+
+// Shows the cursor and restarts its blinking. Called on every key.
+static void restart_blink(struct editor *editor) {
+	editor->is_cursor_visible = true;
+	editor->blink_count = 0;
+	set_timer(editor->blink_timer_fd, blink_nanoseconds, blink_nanoseconds);
+}
+
+// Gives back memory the buffer isn't using, then returns freed heap pages to the system. Runs after
+// every pause in typing, so it only trims once the unused line slots alone are over the budget, which
+// is cheap to check. Slack in line text is only trimmed along with them.
+static void trim_memory(struct editor *editor, void *data) {
+	(void)data;
+	if (buffer_get_line_slack_bytes(&editor->buffer) > editor->trim_slack_budget && buffer_trim(&editor->buffer, editor->trim_slack_budget)) {
+		malloc_trim(0);
+	}
+}
+
+// Reports go in the user's runtime directory, which nobody else can write to. Without one, the name
+// has the user's ID, so users don't clash in the temporary directory.
+static bool get_memory_report_path(char *path, size_t size) {
+	char *runtime_directory = getenv("XDG_RUNTIME_DIR");
+	int length = runtime_directory && *runtime_directory
+		? snprintf(path, size, "%s/%s", runtime_directory, memory_report_name)
+		: snprintf(path, size, "/tmp/%u-%s", (unsigned)getuid(), memory_report_name);
+	return length >= 0 && (size_t)length < size;
+}
+
+static void report_memory(struct editor *editor) {
+	size_t total_bytes = 0;
+	for (int i = 0; i < MEMORY_SUBSYSTEM_COUNT; ++i) {
+		struct memory_counters counters;
+		memory_get_counters(i, &counters);
+		total_bytes += counters.live_bytes;
+	}
+	struct memory_counters buffer_counters;
+	memory_get_counters(MEMORY_SUBSYSTEM_BUFFER, &buffer_counters);
+	struct buffer_memory memory;
+	buffer_get_memory(&editor->buffer, &memory);
+	char path[PATH_MAX];
+	bool has_path = get_memory_report_path(path, sizeof path);
+	bool is_written = has_path && editor_write_memory_report(editor, path);
+	char message[256];
+	snprintf(
+		message, sizeof message, "Counted %zu KiB, buffer %zu KiB, buffer slack %zu KiB. %s%.128s",
+		total_bytes/1024, buffer_counters.live_bytes/1024,
+		(memory.lines_slack_bytes + memory.text_slack_bytes + memory.free_line_bytes)/1024,
+		is_written ? "Report: " : "Couldn't write ", has_path ? path : "the report"
+	);
+	editor_print(editor, message);
+}
+
+static void move_cursor(struct editor *editor, keycode key) {
+	struct buffer *buffer = &editor->buffer;
+	struct mark cursor = *get_cursor(editor);
+	uint32_t length = line_get_length(buffer->lines + buffer_get_line_index(buffer, cursor.y));
+	cursor.x = min(cursor.x, length);
+	if (key == KEY_LEFT) {
+		if (cursor.x) {
+			--cursor.x;
+		} else if (cursor.y) {
+			--cursor.y;
+			cursor.x = UINT32_MAX;
+		}
+	} else if (key == KEY_RIGHT) {
+		if (cursor.x < length) {
+			++cursor.x;
+		} else if (cursor.y + 1 < buffer->line_count) {
+			++cursor.y;
+			cursor.x = 0;
+		}
+	} else if (key == KEY_UP && cursor.y) {
+		--cursor.y;
+	} else if (key == KEY_DOWN && cursor.y + 1 < buffer->line_count) {
+		++cursor.y;
+	}
+	cursor.x = min(cursor.x, line_get_length(buffer->lines + buffer_get_line_index(buffer, cursor.y)));
+	set_cursor(editor, cursor);
+}
+
+// Keeps the cursor on the page.
+static void scroll_to_cursor(struct editor *editor) {
+	struct buffer_view *view = &editor->view;
+	struct mark *cursor = get_cursor(editor);
+	if (cursor->y < view->scroll_y) {
+		view->scroll_y = cursor->y;
+	} else if (view->page_height && cursor->y >= view->scroll_y + view->page_height) {
+		view->scroll_y = cursor->y - view->page_height + 1;
+	}
+	if (cursor->x < view->scroll_x) {
+		view->scroll_x = cursor->x;
+	} else if (view->page_width && cursor->x >= view->scroll_x + view->page_width) {
+		view->scroll_x = cursor->x - view->page_width + 1;
+	}
+}
+
+static void resize(struct editor *editor) {
+	struct signalfd_siginfo information;
+	while (read(editor->signal_fd, &information, sizeof information) == sizeof information);
+	struct winsize size;
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0) {
+		resizeterm(size.ws_row, size.ws_col);
+	}
+	editor_request_redraw(editor);
+}
+
+static void blink(struct editor *editor) {
+	read_counter(editor->blink_timer_fd);
+	++editor->blink_count;
+	if (editor->blink_count >= max_blink_count) {
+		set_timer(editor->blink_timer_fd, 0, 0);
+		editor->is_cursor_visible = true;
+	} else {
+		editor->is_cursor_visible = !editor->is_cursor_visible;
+	}
+	editor_request_redraw(editor);
+}
+
+static void run_debounced(struct editor *editor) {
+	read_counter(editor->debounce_timer_fd);
+	struct completion completion = editor->debounced;
+	editor->debounced = (struct completion){0};
+	if (completion.function) {
+		completion.function(editor, completion.data);
+	}
+}
+
+static void run_completions(struct editor *editor) {
+	read_counter(editor->completion_fd);
+	// Swap the lists so completions can keep being posted while these run.
+	pthread_mutex_lock(&editor->completions_mutex);
+	struct completion *completions = editor->completions;
+	editor->completions = editor->running_completions;
+	editor->running_completions = completions;
+	pthread_mutex_unlock(&editor->completions_mutex);
+
+	for (size_t i = 0; i < list_get_count(&editor->running_completions); ++i) {
+		struct completion *completion = editor->running_completions + i;
+		completion->function(editor, completion->data);
+	}
+	list_set_count(&editor->running_completions, 0);
+}
+
+static void process_file_events(struct editor *editor) {
+	if (!watcher_process_events(&editor->watcher)) {
+		editor_print(editor, "Couldn't reload the file.");
+	}
+	for (size_t i = 0; i < list_get_count(&editor->watcher.changes); ++i) {
+		struct buffer_change *change = editor->watcher.changes + i;
+		if (change->buffer != &editor->buffer) {
+			continue;
+		}
+		if (change->has_conflict) {
+			// A running save replaces the file before the buffer learns the new file's size and inode.
+			if (!editor->is_saving) {
+				editor_print(editor, "The file changed on disk. Saving will overwrite it.");
+			}
+		} else {
+			buffer_view_apply_line_change(&editor->view, &change->change);
+			editor_request_redraw(editor);
+		}
+	}
+}
+
+// Waits for the save thread and finishes its save. Called with the save's generation as `data` when
+// the save thread is done, or with NULL to finish whatever save is running.
+static void finish_save(struct editor *editor, void *data) {
+	if (!editor->is_saving || (data && (uintptr_t)data != editor->save_generation)) {
+		return;
+	}
+	pthread_join(editor->save_thread, NULL);
+	editor->is_saving = false;
+	editor_print(editor, buffer_end_save(&editor->buffer, &editor->save) ? "Saved." : "Couldn't save the file.");
+	editor_request_redraw(editor);
+}
+
+static void *run_save(void *argument) {
+	struct editor *editor = argument;
+	buffer_write_save(&editor->save);
+	editor_post_completion(editor, (struct completion){.function = finish_save, .data = (void*)editor->save_generation});
+	return NULL;
+}
+
+// Writing and syncing a large file takes a while, so it happens on another thread while keys and
+// redraws keep being handled. A save started while another is running waits for it first.
+static void save(struct editor *editor) {
+	finish_save(editor, NULL);
+	if (!buffer_begin_save(&editor->buffer, &editor->save)) {
+		editor_print(editor, "Couldn't save the file.");
+		return;
+	}
+	++editor->save_generation;
+	if (pthread_create(&editor->save_thread, NULL, run_save, editor) != 0) {
+		buffer_write_save(&editor->save);
+		editor_print(editor, buffer_end_save(&editor->buffer, &editor->save) ? "Saved." : "Couldn't save the file.");
+		return;
+	}
+	editor->is_saving = true;
+	editor_print(editor, "Saving...");
+}
+
+// Unsaved edits keep their journal, so they can be recovered the next time the file is opened.
+static void close_journal(struct editor *editor) {
+	if (editor->buffer.journal) {
+		journal_close(&editor->journal, editor->journal_path, true);
+	}
+}
+
+bool editor_initialize(struct editor *editor) {
+	*editor = (struct editor){.trim_slack_budget = default_trim_slack_budget, .is_running = true, .is_cursor_visible = true};
+	// SIGWINCH is read from a signalfd, so it has to be blocked in every thread. Threads started later
+	// inherit the mask.
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGWINCH);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+	editor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (editor->epoll_fd < 0) {
+		goto error1;
+	}
+	editor->signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (editor->signal_fd < 0) {
+		goto error2;
+	}
+	editor->blink_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (editor->blink_timer_fd < 0) {
+		goto error3;
+	}
+	editor->debounce_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (editor->debounce_timer_fd < 0) {
+		goto error4;
+	}
+	editor->frame_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (editor->frame_timer_fd < 0) {
+		goto error5;
+	}
+	editor->completion_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (editor->completion_fd < 0) {
+		goto error6;
+	}
+	editor->completions = list_create(initial_completions_capacity, sizeof *editor->completions);
+	if (!editor->completions) {
+		goto error7;
+	}
+	editor->running_completions = list_create(initial_completions_capacity, sizeof *editor->running_completions);
+	if (!editor->running_completions) {
+		goto error8;
+	}
+	editor->message = list_create(initial_message_capacity, sizeof *editor->message);
+	if (!editor->message) {
+		goto error9;
+	}
+	if (!buffer_initialize(&editor->buffer, initial_lines_capacity, initial_line_capacity)) {
+		goto error10;
+	}
+	if (!buffer_view_initialize(&editor->view, &editor->buffer, COLS, max(1, LINES - 1))) {
+		goto error11;
+	}
+	if (!watcher_initialize(&editor->watcher, NULL)) {
+		goto error12;
+	}
+	int fds[] = {STDIN_FILENO, editor->signal_fd, editor->blink_timer_fd, editor->debounce_timer_fd, editor->frame_timer_fd, editor->completion_fd, editor->watcher.fd};
+	for (size_t i = 0; i < sizeof fds/sizeof *fds; ++i) {
+		if (!watch_fd(editor->epoll_fd, fds[i])) {
+			goto error13;
+		}
+	}
+	pthread_mutex_init(&editor->completions_mutex, NULL);
+	editor->message[0] = '\0';
+	list_set_count(&editor->message, 1);
+	nodelay(stdscr, TRUE);
+	restart_blink(editor);
+	editor->needs_redraw = true;
+	return true;
+
+error13:
+	watcher_destroy(&editor->watcher);
+error12:
+	buffer_view_destroy(&editor->view);
+error11:
+	buffer_destroy(&editor->buffer);
+error10:
+	list_destroy(&editor->message);
+error9:
+	list_destroy(&editor->running_completions);
+error8:
+	list_destroy(&editor->completions);
+error7:
+	close(editor->completion_fd);
+error6:
+	close(editor->frame_timer_fd);
+error5:
+	close(editor->debounce_timer_fd);
+error4:
+	close(editor->blink_timer_fd);
+error3:
+	close(editor->signal_fd);
+error2:
+	close(editor->epoll_fd);
+error1:
+	*editor = (struct editor){0};
+	return false;
+}
+
+void editor_destroy(struct editor *editor) {
+	finish_save(editor, NULL);
+	pthread_mutex_destroy(&editor->completions_mutex);
+	close_journal(editor);
+	watcher_destroy(&editor->watcher);
+	buffer_view_destroy(&editor->view);
+	buffer_destroy(&editor->buffer);
+	list_destroy(&editor->message);
+	list_destroy(&editor->running_completions);
+	list_destroy(&editor->completions);
+	close(editor->completion_fd);
+	close(editor->frame_timer_fd);
+	close(editor->debounce_timer_fd);
+	close(editor->blink_timer_fd);
+	close(editor->signal_fd);
+	close(editor->epoll_fd);
+	*editor = (struct editor){0};
+}
+
+bool editor_open_file(struct editor *editor, char *file_path) {
+	struct buffer *buffer = &editor->buffer;
+	finish_save(editor, NULL);
+	watcher_unwatch_buffer(&editor->watcher, buffer);
+	close_journal(editor);
+	if (!buffer_load_file(buffer, file_path)) {
+		return false;
+	}
+	if (journal_get_path(file_path, editor->journal_path, sizeof editor->journal_path)) {
+		uint32_t last_y = buffer->line_count - 1;
+		struct mark file_end = {line_get_length(buffer->lines + buffer_get_line_index(buffer, last_y)), last_y};
+		// A journal that doesn't match the file is left over from an older version of it, and is replaced.
+		bool is_recovered = access(editor->journal_path, F_OK) == 0 && journal_recover(buffer, file_path, editor->journal_path) && buffer->is_modified;
+		// The new journal starts from the file on disk, which doesn't have the recovered edits, so they're
+		// journaled again. Otherwise a second crash would lose them.
+		if (!journal_open(&editor->journal, buffer, editor->journal_path, journal_commit_delay_milliseconds) || (is_recovered && !buffer_journal_text(buffer, file_end))) {
+			editor_print(editor, "Couldn't start the journal. Edits won't survive a crash.");
+		} else if (is_recovered) {
+			editor_print(editor, "Recovered unsaved edits.");
+		}
+	}
+	set_cursor(editor, (struct mark){0});
+	list_set_count(&editor->view.matches, 0);
+	editor->view.scroll_x = 0;
+	editor->view.scroll_y = 0;
+	editor_request_redraw(editor);
+	return watcher_watch_buffer(&editor->watcher, &editor->buffer);
+}
+
+keycode editor_read_key(struct editor *editor) {
+	(void)editor;
+	int key = getch();
+	if (key == ERR) {
+		return EDITOR_KEY_NONE;
+	}
+	return key;
+}
+
+void editor_process_key(struct editor *editor, keycode key) {
+	struct buffer *buffer = &editor->buffer;
+	struct mark cursor = *get_cursor(editor);
+	restart_blink(editor);
+	editor_request_redraw(editor);
+
+	if (key == control('q')) {
+		editor->is_running = false;
+	} else if (key == control('s')) {
+		save(editor);
+	} else if (key == control('g')) {
+		report_memory(editor);
+	} else if (key == KEY_LEFT || key == KEY_RIGHT || key == KEY_UP || key == KEY_DOWN) {
+		move_cursor(editor, key);
+	} else if (key == '\n' || key == '\r' || key == KEY_ENTER) {
+		buffer_insert_text(buffer, cursor, (char8*)"\n", 1, &cursor);
+		set_cursor(editor, cursor);
+	} else if (key == KEY_BACKSPACE || key == 127 || key == control('h')) {
+		move_cursor(editor, KEY_LEFT);
+		struct mark start = *get_cursor(editor);
+		buffer_delete_text(buffer, (struct selection){.start = start, .end = cursor});
+	} else if ((key >= ' ' && key < 127) || (key >= 128 && key < 256)) {
+		char8 character = key;
+		buffer_insert_text(buffer, cursor, &character, 1, &cursor);
+		set_cursor(editor, cursor);
+	}
+	editor_debounce(editor, (struct completion){.function = trim_memory}, trim_delay_milliseconds);
+}
+
+void editor_print(struct editor *editor, char *text) {
+	size_t length = strlen(text);
+	if (length + 1 > list_get_capacity(&editor->message) && !list_set_capacity(&editor->message, length + 1)) {
+		return;
+	}
+	memcpy(editor->message, text, length + 1);
+	list_set_count(&editor->message, length + 1);
+	editor_request_redraw(editor);
+}
+
+bool editor_write_memory_report(struct editor *editor, char *path) {
+	// The old report is replaced by a new file, never written through, so a link planted at the path
+	// can't point the report at another file.
+	if (unlink(path) != 0 && errno != ENOENT) {
+		return false;
+	}
+	int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		return false;
+	}
+	FILE *file = fdopen(fd, "w");
+	if (!file) {
+		close(fd);
+		return false;
+	}
+	memory_write_counters(file);
+	struct buffer_memory memory;
+	buffer_get_memory(&editor->buffer, &memory);
+	fprintf(
+		file,
+		"open buffer: %zu live bytes in %u allocations, %u line slots, %u free lines\n"
+		"buffer slack: %zu bytes in the lines list, %zu bytes in line text, %zu bytes in free lines\n"
+		"trim slack budget: %zu bytes\n",
+		memory.live_bytes, memory.allocation_count, memory.line_slot_count, memory.free_line_count,
+		memory.lines_slack_bytes, memory.text_slack_bytes, memory.free_line_bytes,
+		editor->trim_slack_budget
+	);
+	return fclose(file) == 0;
+}
+
+void editor_request_redraw(struct editor *editor) {
+	editor->needs_redraw = true;
+}
+
+void editor_draw(struct editor *editor) {
+	struct buffer *buffer = &editor->buffer;
+	struct buffer_view *view = &editor->view;
+	int rows = 0;
+	int columns = 0;
+	getmaxyx(stdscr, rows, columns);
+	view->page_width = max(1, columns);
+	view->page_height = max(1, rows - 1); // Subtracting 1 for the message row.
+	scroll_to_cursor(editor);
+
+	erase();
+	uint32_t line_index = buffer_get_line_index(buffer, view->scroll_y);
+	for (uint32_t y = 0; y < view->page_height && line_index != BUFFER_NONE; ++y) {
+		struct line *line = buffer->lines + line_index;
+		uint32_t length = line_get_length(line);
+		if (length > view->scroll_x) {
+			mvaddnstr(y, 0, (char*)line->text + view->scroll_x, min(length - view->scroll_x, view->page_width));
+		}
+		line_index = line->next_index;
+	}
+	mvaddnstr(rows - 1, 0, editor->message, columns);
+
+	struct mark *cursor = get_cursor(editor);
+	curs_set(editor->is_cursor_visible);
+	move(cursor->y - view->scroll_y, cursor->x - view->scroll_x);
+	refresh();
+	editor->last_draw_time = get_time();
+	editor->needs_redraw = false;
+}
+
+void editor_update(struct editor *editor) {
+	struct epoll_event events[16];
+	int event_count = epoll_wait(editor->epoll_fd, events, sizeof events/sizeof *events, -1);
+	for (int i = 0; i < event_count; ++i) {
+		int fd = events[i].data.fd;
+		if (fd == STDIN_FILENO) {
+			keycode key;
+			while ((key = editor_read_key(editor)) != EDITOR_KEY_NONE) {
+				editor_process_key(editor, key);
+			}
+		} else if (fd == editor->signal_fd) {
+			resize(editor);
+		} else if (fd == editor->blink_timer_fd) {
+			blink(editor);
+		} else if (fd == editor->debounce_timer_fd) {
+			run_debounced(editor);
+		} else if (fd == editor->frame_timer_fd) {
+			read_counter(editor->frame_timer_fd);
+			editor->is_frame_pending = false;
+		} else if (fd == editor->completion_fd) {
+			run_completions(editor);
+		} else if (fd == editor->watcher.fd) {
+			process_file_events(editor);
+		}
+	}
+
+	// Draw now if the last frame was long enough ago, otherwise wait for the frame timer.
+	if (editor->needs_redraw && !editor->is_frame_pending) {
+		uint64_t elapsed = get_time() - editor->last_draw_time;
+		if (elapsed >= frame_nanoseconds) {
+			editor_draw(editor);
+		} else {
+			set_timer(editor->frame_timer_fd, frame_nanoseconds - elapsed, 0);
+			editor->is_frame_pending = true;
+		}
+	}
+}
+
+bool editor_post_completion(struct editor *editor, struct completion completion) {
+	pthread_mutex_lock(&editor->completions_mutex);
+	bool pushed = list_push_back(&editor->completions, &completion) != NULL;
+	pthread_mutex_unlock(&editor->completions_mutex);
+	if (!pushed) {
+		return false;
+	}
+	uint64_t increment = 1;
+	(void)!write(editor->completion_fd, &increment, sizeof increment);
+	return true;
+}
+
+void editor_debounce(struct editor *editor, struct completion completion, uint32_t milliseconds) {
+	editor->debounced = completion;
+	set_timer(editor->debounce_timer_fd, max(1, (uint64_t)milliseconds*1000000), 0);
+}
+
+#undef min
+#undef max
+#undef control
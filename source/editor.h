@@ -3,23 +3,95 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include "buffer.h"
+#include "journal.h"
+#include "watcher.h"
+
+// Returned by `editor_read_key` when there's no more input.
+#define EDITOR_KEY_NONE UINT32_MAX
 
 typedef uint32_t keycode;
 
 struct editor;
 
+// Work handed back to the editor's thread. `function` runs inside `editor_update`.
+struct completion {
+	void (*function)(struct editor *editor, void *data);
+	void *data;
+};
+
+// The editor sleeps in `epoll_wait` until the terminal, a signal, a timer, a watched file, or a
+// background thread has something for it, so it uses no CPU while idle.
+struct editor {
+	int epoll_fd;
+	int signal_fd; // Readable when the terminal is resized.
+	int blink_timer_fd; // Toggles the cursor.
+	int debounce_timer_fd; // Runs `debounced` once input has been quiet for a while.
+	int frame_timer_fd; // Fires when a redraw that was held back can happen.
+	int completion_fd; // An eventfd. Written to whenever a completion is posted.
+	pthread_mutex_t completions_mutex; // Guards `completions`.
+	struct completion *completions; // Points to a list. Posted by other threads.
+	struct completion *running_completions; // Points to a list. Only used by the editor's thread.
+	struct completion debounced;
+	struct buffer buffer;
+	struct buffer_view view;
+	struct watcher watcher;
+	struct journal journal; // Only open while `buffer.journal` points to it.
+	char journal_path[PATH_MAX];
+	struct buffer_save save; // Only used by the save thread while `is_saving` is set.
+	pthread_t save_thread;
+	uintptr_t save_generation; // Counts saves, so a completion posted by an earlier save is ignored.
+	char *message; // Points to a list. Null terminated. Shown on the last row.
+	uint64_t last_draw_time; // In nanoseconds, from CLOCK_MONOTONIC.
+	uint32_t blink_count; // Blinks since the last key. The cursor stops blinking after a while.
+	size_t trim_slack_budget; // Slack bytes the buffer may keep when it's trimmed after typing stops.
+	bool is_running;
+	bool is_saving;
+	bool needs_redraw;
+	bool is_frame_pending; // A redraw is waiting on `frame_timer_fd`.
+	bool is_cursor_visible;
+};
+
+// Call after the terminal is set up.
 bool editor_initialize(struct editor *editor);
 
 void editor_destroy(struct editor *editor);
 
+// Loads a file into the editor's buffer and watches it for changes. Edits left in the file's journal
+// by a crash are replayed, and a new journal is started for the buffer. Returns false if memory or IO
+// error.
+bool editor_open_file(struct editor *editor, char *file_path);
+
+// Returns EDITOR_KEY_NONE if no key is waiting.
 keycode editor_read_key(struct editor *editor);
 
 void editor_process_key(struct editor *editor, keycode key);
 
+// Shows `text` on the last row until the next message.
 void editor_print(struct editor *editor, char *text);
 
+// Writes the memory counted for each subsystem, and where the buffer's memory goes, to a new file at
+// `path`, replacing whatever was there. A symbolic link at `path` is never followed. Returns false if IO
+// error.
+bool editor_write_memory_report(struct editor *editor, char *path);
+
+// Marks the screen as out of date. The redraw happens at the end of `editor_update`, at most once per
+// frame.
+void editor_request_redraw(struct editor *editor);
+
 void editor_draw(struct editor *editor);
 
+// Waits for at least one event and handles every event that's ready.
 void editor_update(struct editor *editor);
 
+// Runs `completion` on the editor's thread. Safe to call from any thread. Returns false if memory
+// error.
+bool editor_post_completion(struct editor *editor, struct completion completion);
+
+// Runs `completion` once no other call to this function has been made for `milliseconds`. Replaces
+// any completion that's still waiting.
+void editor_debounce(struct editor *editor, struct completion completion, uint32_t milliseconds);
+
 #endif // EDITOR_H
@@ -0,0 +1,1358 @@
+#define _GNU_SOURCE
+#define MEMORY_SUBSYSTEM MEMORY_SUBSYSTEM_FILE_BROWSER
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "file_browser.h"
+#include "list.h"
+#include "map.h"
+#include "memory.h"
+
+#define min(a, b) (((a) <= (b)) ? (a) : (b))
+#define max(a, b) (((a) >= (b)) ? (a) : (b))
+
+// The record layout returned by the `getdents64` system call. glibc doesn't declare it.
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+// A directory waiting to be read by `file_browser_scan`.
+struct queued_directory {
+	char *path; // Allocated with `memory_duplicate_string`. Relative to the root.
+	struct ignore_file *ignore_file; // The nearest `.gitignore` above the directory, or NULL.
+};
+
+// One thread of `file_browser_scan`. Each worker reads directories off its own stack and pushes the
+// subdirectories it finds back onto it. Idle workers steal from the other stacks, and sleep while
+// every stack is empty.
+struct walk_worker {
+	pthread_t thread;
+	pthread_mutex_t mutex; // Guards `directories`.
+	struct queued_directory *directories; // Points to a list.
+	char *paths; // Points to a list. Null terminated file paths stored back to back.
+	char *directory_paths; // Points to a list. Null terminated paths of the directories read.
+	struct ignore_file **ignore_files; // Points to a list. The `.gitignore` files this worker read.
+	struct walk *walk;
+	uint32_t index;
+};
+
+// The state shared between the workers of `file_browser_scan`.
+struct walk {
+	struct file_browser *browser;
+	struct walk_worker *workers;
+	uint32_t worker_count;
+	int root_fd;
+	pthread_mutex_t mutex; // Guards the counts.
+	pthread_cond_t condition; // Signaled when a directory is queued or the last one is read.
+	uint32_t queued_count; // Directories in the stacks.
+	uint32_t pending_count; // Directories queued or being read.
+	bool failed; // Accessed atomically.
+};
+
+// One slice of `file_browser_search`. Keeps the best matches of its slice of the entries in a heap.
+// The tasks live as long as the browser, so their lists keep their capacity from one search to the
+// next.
+struct search_task {
+	pthread_t thread; // Runs the task. Unused by the first task, which runs on the searching thread.
+	struct search_pool *pool;
+	struct file_browser *browser;
+	char *query;
+	uint64_t query_mask;
+	uint32_t *source; // `file_browser.candidates` if narrowing the last search, NULL to search every entry.
+	uint32_t begin_index; // Index into `source`, or into `file_browser.entries` if there's no source.
+	uint32_t end_index;
+	uint32_t max_matches;
+	struct file_match *matches; // Points to a list. A heap with the worst match at the front.
+	uint32_t *found; // Points to a list. Every entry that matched, in order.
+	bool found_failed; // Set if `found` couldn't grow. The matches are still correct.
+};
+
+// The threads of `file_browser_search`, started by `file_browser_initialize` so typing a query
+// doesn't create threads. Worker `i` runs `tasks[i]` whenever a search starts that has that many
+// tasks, and sleeps between searches.
+struct search_pool {
+	struct search_task *tasks; // Allocated with `memory_allocate_zeroed`. `file_browser.thread_count` of them.
+	uint32_t worker_count; // Workers started. Slices past them are scored by the searching thread.
+	pthread_mutex_t mutex; // Guards the fields below.
+	pthread_cond_t start_condition; // Broadcast when a search starts or the pool stops.
+	pthread_cond_t done_condition; // Signaled when the last worker of a search finishes.
+	uint64_t generation; // Incremented when a search starts.
+	uint32_t task_count; // Tasks in the current search, counting the searching thread's.
+	uint32_t running_count; // Workers still scoring the current search.
+	bool is_stopping;
+};
+
+static const size_t initial_root_path_capacity = 4*1024;
+
+static const size_t initial_paths_capacity = 64*1024;
+
+static const size_t initial_ignore_patterns_capacity = 16;
+
+static const size_t initial_ignore_files_capacity = 64;
+
+static const size_t initial_matches_capacity = 64;
+
+static const size_t initial_directories_capacity = 64;
+
+static const size_t initial_query_capacity = 256;
+
+// Searches with fewer entries than this run on the calling thread only.
+static const uint32_t min_entries_per_search_thread = 64*1024;
+
+static const size_t dirent_buffer_size = 32*1024;
+
+static const int32_t match_score = 16;
+
+static const int32_t boundary_bonus = 24;
+
+static const int32_t consecutive_bonus = 16;
+
+static const int32_t name_bonus = 8;
+
+static const int32_t gap_penalty = 1;
+
+static const size_t max_penalized_gap = 8;
+
+static const size_t length_penalty_divisor = 16;
+
+// Folds ASCII upper case to lower case. Cheaper than `tolower`, which goes through the locale.
+static inline char fold_case(char character) {
+	return (unsigned char)(character - 'A') < 26 ? character | 0x20 : character;
+}
+
+// Returns the bit of `file_entry.character_mask` that `character` maps to. Letters are folded to lower
+// case so the mask can be used for case-insensitive matching.
+static uint64_t get_character_bit(unsigned char character) {
+	character = fold_case(character);
+	if (character >= 'a' && character <= 'z') {
+		return 1ull << (character - 'a');
+	}
+	if (character >= '0' && character <= '9') {
+		return 1ull << (26 + character - '0');
+	}
+	return 1ull << (36 + character%28);
+}
+
+// Builds the mask for a whole string. A path can only match a query if the path's mask contains all
+// of the query's bits, which rules out most paths with a single AND.
+static uint64_t get_character_mask(char *text) {
+	uint64_t mask = 0;
+	while (*text) {
+		mask |= get_character_bit(*text);
+		++text;
+	}
+	return mask;
+}
+
+// Appends `length` bytes of `text` and a null terminator to the list `*list`. Returns the offset of the
+// copy, or SIZE_MAX if memory error.
+static size_t append_string(char **list, char *text, size_t length) {
+	size_t count = list_get_count(list);
+	size_t capacity = list_get_capacity(list);
+	if (count + length + 1 > capacity) {
+		size_t new_capacity = max(count + length + 1, list_growth_factor*capacity);
+		if (!list_set_capacity(list, new_capacity)) {
+			return SIZE_MAX;
+		}
+	}
+	memcpy(*list + count, text, length);
+	(*list)[count + length] = '\0';
+	list_set_count(list, count + length + 1);
+	return count;
+}
+
+static void destroy_ignore_file(struct ignore_file *file) {
+	for (size_t i = 0; i < list_get_count(&file->patterns); ++i) {
+		list_destroy(&file->patterns[i].text);
+	}
+	list_destroy(&file->patterns);
+	list_destroy(&file->directory);
+	memory_free(file);
+}
+
+// Adds one line of a `.gitignore` file. Blank lines and comments are skipped. Returns false if memory
+// error.
+static bool add_ignore_pattern(struct ignore_file *file, char *line, size_t length) {
+	while (length && isspace((unsigned char)line[length - 1])) {
+		--length;
+	}
+	if (length == 0 || line[0] == '#') {
+		return true;
+	}
+
+	struct ignore_pattern pattern = {0};
+	if (line[0] == '!') {
+		pattern.is_negated = true;
+		++line;
+		--length;
+	} else if (line[0] == '\\') {
+		// Escapes a leading `#` or `!`.
+		++line;
+		--length;
+	}
+	if (length && line[length - 1] == '/') {
+		pattern.is_directory_only = true;
+		--length;
+	}
+	if (length && line[0] == '/') {
+		pattern.is_anchored = true;
+		++line;
+		--length;
+	}
+	if (length == 0) {
+		return true;
+	}
+	if (memchr(line, '/', length)) {
+		pattern.is_anchored = true;
+	}
+
+	pattern.text = list_create(length + 1, sizeof *pattern.text);
+	if (!pattern.text) {
+		return false;
+	}
+	append_string(&pattern.text, line, length);
+	if (!list_push_back(&file->patterns, &pattern)) {
+		list_destroy(&pattern.text);
+		return false;
+	}
+	return true;
+}
+
+// Reads the `.gitignore` in `directory`, which `directory_fd` is open on. Sets `*result` to NULL if
+// there isn't one. Returns false if memory error.
+static bool load_ignore_file(int directory_fd, char *directory, struct ignore_file *parent, struct ignore_file **result) {
+	*result = NULL;
+	int fd = openat(directory_fd, ".gitignore", O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return true;
+	}
+	char *text = list_create(4*1024, sizeof *text);
+	if (!text) {
+		goto error1;
+	}
+	char chunk[4*1024];
+	ssize_t read_size = 0;
+	while ((read_size = read(fd, chunk, sizeof chunk)) > 0) {
+		if (append_string(&text, chunk, read_size) == SIZE_MAX) {
+			goto error2;
+		}
+		// Drop the terminator so the next chunk continues the text.
+		list_set_count(&text, list_get_count(&text) - 1);
+	}
+
+	struct ignore_file *file = memory_allocate(sizeof *file);
+	if (!file) {
+		goto error2;
+	}
+	*file = (struct ignore_file){.parent = parent};
+	file->directory = list_create(strlen(directory) + 1, sizeof *file->directory);
+	if (!file->directory) {
+		goto error3;
+	}
+	append_string(&file->directory, directory, strlen(directory));
+	file->patterns = list_create(initial_ignore_patterns_capacity, sizeof *file->patterns);
+	if (!file->patterns) {
+		goto error4;
+	}
+	size_t count = list_get_count(&text);
+	size_t line_start = 0;
+	for (size_t i = 0; i <= count; ++i) {
+		if (i == count || text[i] == '\n') {
+			if (!add_ignore_pattern(file, text + line_start, i - line_start)) {
+				destroy_ignore_file(file);
+				goto error2;
+			}
+			line_start = i + 1;
+		}
+	}
+	list_destroy(&text);
+	close(fd);
+	*result = file;
+	return true;
+
+error4:
+	list_destroy(&file->directory);
+error3:
+	memory_free(file);
+error2:
+	list_destroy(&text);
+error1:
+	close(fd);
+	return false;
+}
+
+// Returns true if `path` is `directory` or inside it. Every path is inside the root, which is "".
+static bool is_in_directory(char *path, char *directory) {
+	size_t length = strlen(directory);
+	return length == 0 || (strncmp(path, directory, length) == 0 && (path[length] == '\0' || path[length] == '/'));
+}
+
+// Returns true if `path` is ignored by `file` or the files above it.
+static bool is_ignored(struct ignore_file *file, char *path, bool is_directory) {
+	char *name = strrchr(path, '/');
+	name = name ? name + 1 : path;
+	if (is_directory && strcmp(name, ".git") == 0) {
+		return true;
+	}
+	for (; file; file = file->parent) {
+		// Anchored patterns match from the directory the `.gitignore` is in.
+		size_t directory_length = list_get_count(&file->directory) - 1; // Subtracting 1 for the null terminator.
+		char *relative_path = directory_length ? path + directory_length + 1 : path;
+		for (size_t i = list_get_count(&file->patterns); i > 0; --i) {
+			struct ignore_pattern *pattern = file->patterns + i - 1;
+			if (pattern->is_directory_only && !is_directory) {
+				continue;
+			}
+			bool is_match = pattern->is_anchored ? fnmatch(pattern->text, relative_path, FNM_PATHNAME) == 0 : fnmatch(pattern->text, name, 0) == 0;
+			if (is_match) {
+				return !pattern->is_negated;
+			}
+		}
+	}
+	return false;
+}
+
+// Returns the `.gitignore` of `directory` or of the nearest directory above it, or NULL if there isn't
+// one.
+static struct ignore_file *find_ignore_file(struct file_browser *browser, char *directory) {
+	char path[PATH_MAX];
+	size_t length = strlen(directory);
+	if (length >= sizeof path) {
+		return NULL;
+	}
+	memcpy(path, directory, length + 1);
+	while (true) {
+		struct ignore_file **file = map_get(&browser->ignore_files, path);
+		if (file) {
+			return *file;
+		}
+		if (length == 0) {
+			return NULL;
+		}
+		while (length && path[length] != '/') {
+			--length;
+		}
+		path[length] = '\0';
+	}
+}
+
+// Forgets the `.gitignore` files in `directory` and under it.
+static void remove_ignore_files(struct file_browser *browser, char *directory) {
+	size_t index = 0;
+	while (index < map_get_buckets_capacity(&browser->ignore_files)) {
+		struct ignore_file *file = browser->ignore_files[index];
+		if (!map_index_is_full(&browser->ignore_files, index) || !is_in_directory(file->directory, directory)) {
+			++index;
+			continue;
+		}
+		// Removing leaves the other buckets where they are, unless the map shrinks.
+		size_t buckets_capacity = map_get_buckets_capacity(&browser->ignore_files);
+		map_remove(&browser->ignore_files, file->directory);
+		destroy_ignore_file(file);
+		if (map_get_buckets_capacity(&browser->ignore_files) != buckets_capacity) {
+			index = 0;
+		}
+	}
+}
+
+// Removes every entry but keeps the allocations. Returns false if memory error.
+static bool clear_entries(struct file_browser *browser) {
+	size_t buckets_capacity = map_get_buckets_capacity(&browser->entry_indices);
+	uint32_t *entry_indices = map_create(buckets_capacity, sizeof *entry_indices, initial_paths_capacity);
+	if (!entry_indices) {
+		return false;
+	}
+	buckets_capacity = map_get_buckets_capacity(&browser->directory_indices);
+	uint32_t *directory_indices = map_create(buckets_capacity, sizeof *directory_indices, initial_root_path_capacity);
+	if (!directory_indices) {
+		map_destroy(&entry_indices);
+		return false;
+	}
+	map_destroy(&browser->entry_indices);
+	browser->entry_indices = entry_indices;
+	map_destroy(&browser->directory_indices);
+	browser->directory_indices = directory_indices;
+	list_set_count(&browser->paths, 0);
+	list_set_count(&browser->directory_paths, 0);
+	list_set_count(&browser->entries, 0);
+	list_set_count(&browser->directories, 0);
+	list_set_count(&browser->matches, 0);
+	browser->removed_count = 0;
+	browser->has_candidates = false;
+	return true;
+}
+
+// Adds the directory at `path` and the directories above it if they aren't in the index, and marks
+// them as not removed. `path` is changed while this runs, but is the same when it returns. Returns
+// the directory's index, or FILE_BROWSER_NONE if memory error.
+static uint32_t add_directory(struct file_browser *browser, char *path, size_t length) {
+	uint32_t *existing_index = map_get(&browser->directory_indices, path);
+	if (existing_index && !browser->directories[*existing_index].is_removed) {
+		return *existing_index;
+	}
+
+	uint32_t parent_index = FILE_BROWSER_NONE;
+	if (length) {
+		char *slash = memrchr(path, '/', length);
+		size_t parent_length = slash ? (size_t)(slash - path) : 0;
+		char separator = path[parent_length];
+		path[parent_length] = '\0';
+		parent_index = add_directory(browser, path, parent_length);
+		path[parent_length] = separator;
+		if (parent_index == FILE_BROWSER_NONE) {
+			return FILE_BROWSER_NONE;
+		}
+	}
+	if (existing_index) {
+		browser->directories[*existing_index].is_removed = false;
+		return *existing_index;
+	}
+
+	size_t path_index = append_string(&browser->directory_paths, path, length);
+	if (path_index == SIZE_MAX) {
+		return FILE_BROWSER_NONE;
+	}
+	uint32_t directory_index = list_get_count(&browser->directories);
+	struct directory_entry directory = {
+		.path_index = path_index,
+		.parent_index = parent_index,
+		.first_file_index = FILE_BROWSER_NONE,
+		.first_directory_index = FILE_BROWSER_NONE,
+		.next_index = parent_index == FILE_BROWSER_NONE ? FILE_BROWSER_NONE : browser->directories[parent_index].first_directory_index,
+	};
+	if (!list_push_back(&browser->directories, &directory)) {
+		goto error;
+	}
+	if (!map_add(&browser->directory_indices, path, &directory_index)) {
+		list_set_count(&browser->directories, directory_index);
+		goto error;
+	}
+	if (parent_index != FILE_BROWSER_NONE) {
+		browser->directories[parent_index].first_directory_index = directory_index;
+	}
+	return directory_index;
+
+error:
+	list_set_count(&browser->directory_paths, path_index);
+	return FILE_BROWSER_NONE;
+}
+
+// Adds a file to the index in the directory at `directory_index`. Returns false if memory error.
+static bool add_path(struct file_browser *browser, char *path, uint32_t directory_index) {
+	uint32_t *existing_index = map_get(&browser->entry_indices, path);
+	if (existing_index) {
+		struct file_entry *entry = browser->entries + *existing_index;
+		if (entry->is_removed) {
+			entry->is_removed = false;
+			--browser->removed_count;
+			browser->has_candidates = false;
+		}
+		return true;
+	}
+
+	size_t length = strlen(path);
+	size_t path_index = append_string(&browser->paths, path, length);
+	if (path_index == SIZE_MAX) {
+		return false;
+	}
+	char *name = strrchr(path, '/');
+	struct directory_entry *directory = browser->directories + directory_index;
+	struct file_entry entry = {
+		.path_index = path_index,
+		.path_length = length,
+		.name_index = name ? name + 1 - path : 0,
+		.next_index = directory->first_file_index,
+		.character_mask = get_character_mask(path),
+	};
+	uint32_t entry_index = list_get_count(&browser->entries);
+	if (!list_push_back(&browser->entries, &entry)) {
+		goto error;
+	}
+	if (!map_add(&browser->entry_indices, path, &entry_index)) {
+		list_set_count(&browser->entries, entry_index);
+		goto error;
+	}
+	directory->first_file_index = entry_index;
+	// The new path was never scored, so the next search can't be narrowed.
+	browser->has_candidates = false;
+	return true;
+
+error:
+	list_set_count(&browser->paths, path_index);
+	return false;
+}
+
+// Marks the directory, its files, and everything under it as removed. Returns how many files were
+// removed.
+static uint32_t remove_directory(struct file_browser *browser, uint32_t directory_index) {
+	struct directory_entry *directory = browser->directories + directory_index;
+	directory->is_removed = true;
+	uint32_t removed_count = 0;
+	for (uint32_t entry_index = directory->first_file_index; entry_index != FILE_BROWSER_NONE; entry_index = browser->entries[entry_index].next_index) {
+		struct file_entry *entry = browser->entries + entry_index;
+		removed_count += !entry->is_removed;
+		entry->is_removed = true;
+	}
+	for (uint32_t child_index = directory->first_directory_index; child_index != FILE_BROWSER_NONE; child_index = browser->directories[child_index].next_index) {
+		if (!browser->directories[child_index].is_removed) {
+			removed_count += remove_directory(browser, child_index);
+		}
+	}
+	return removed_count;
+}
+
+// Pushes a directory for a worker to read and wakes a sleeping worker. Takes ownership of
+// `directory.path`. Returns false if memory error.
+static bool push_directory(struct walk_worker *worker, struct queued_directory directory) {
+	struct walk *walk = worker->walk;
+	pthread_mutex_lock(&worker->mutex);
+	bool pushed = list_push_back(&worker->directories, &directory) != NULL;
+	pthread_mutex_unlock(&worker->mutex);
+	if (!pushed) {
+		memory_free(directory.path);
+		return false;
+	}
+	pthread_mutex_lock(&walk->mutex);
+	++walk->queued_count;
+	++walk->pending_count;
+	pthread_cond_signal(&walk->condition);
+	pthread_mutex_unlock(&walk->mutex);
+	return true;
+}
+
+// Takes a directory from the worker's own stack, or steals one from another worker. Sleeps while
+// every stack is empty and other workers are still reading. Returns false once every directory has
+// been read.
+static bool take_directory(struct walk_worker *worker, struct queued_directory *directory) {
+	struct walk *walk = worker->walk;
+	while (true) {
+		for (uint32_t i = 0; i < walk->worker_count; ++i) {
+			struct walk_worker *victim = walk->workers + (worker->index + i)%walk->worker_count;
+			pthread_mutex_lock(&victim->mutex);
+			bool popped = list_pop_back(&victim->directories, directory);
+			pthread_mutex_unlock(&victim->mutex);
+			if (popped) {
+				pthread_mutex_lock(&walk->mutex);
+				--walk->queued_count;
+				pthread_mutex_unlock(&walk->mutex);
+				return true;
+			}
+		}
+		// The directories being read may still have subdirectories to queue.
+		pthread_mutex_lock(&walk->mutex);
+		while (walk->queued_count == 0 && walk->pending_count != 0) {
+			pthread_cond_wait(&walk->condition, &walk->mutex);
+		}
+		bool is_done = walk->pending_count == 0;
+		pthread_mutex_unlock(&walk->mutex);
+		if (is_done) {
+			return false;
+		}
+	}
+}
+
+// Reads one directory, queuing its subdirectories and recording its files.
+static void read_directory(struct walk_worker *worker, struct queued_directory *queued, char *dirent_buffer) {
+	struct walk *walk = worker->walk;
+	char *directory = queued->path;
+	int fd = openat(walk->root_fd, *directory ? directory : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		// Directories we can't read are skipped, the same as `find` does.
+		return;
+	}
+
+	struct ignore_file *ignore_file = NULL;
+	if (!load_ignore_file(fd, directory, queued->ignore_file, &ignore_file)) {
+		__atomic_store_n(&walk->failed, true, __ATOMIC_RELEASE);
+	}
+	if (ignore_file && !list_push_back(&worker->ignore_files, &ignore_file)) {
+		destroy_ignore_file(ignore_file);
+		ignore_file = NULL;
+		__atomic_store_n(&walk->failed, true, __ATOMIC_RELEASE);
+	}
+	if (!ignore_file) {
+		ignore_file = queued->ignore_file;
+	}
+
+	size_t directory_length = strlen(directory);
+	if (append_string(&worker->directory_paths, directory, directory_length) == SIZE_MAX) {
+		__atomic_store_n(&walk->failed, true, __ATOMIC_RELEASE);
+	}
+	char path[PATH_MAX];
+	memcpy(path, directory, directory_length);
+	size_t name_start = directory_length;
+	if (directory_length) {
+		path[name_start++] = '/';
+	}
+
+	long read_size = 0;
+	while ((read_size = syscall(SYS_getdents64, fd, dirent_buffer, dirent_buffer_size)) > 0) {
+		for (long offset = 0; offset < read_size;) {
+			struct linux_dirent64 *dirent = (struct linux_dirent64*)(dirent_buffer + offset);
+			offset += dirent->d_reclen;
+			char *name = dirent->d_name;
+			if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+				continue;
+			}
+			size_t name_length = strlen(name);
+			if (name_start + name_length + 1 > sizeof path) {
+				continue;
+			}
+			memcpy(path + name_start, name, name_length + 1);
+
+			unsigned char type = dirent->d_type;
+			if (type == DT_UNKNOWN) {
+				// Some file systems don't fill in the type.
+				struct stat status;
+				if (fstatat(fd, name, &status, AT_SYMLINK_NOFOLLOW) != 0) {
+					continue;
+				}
+				type = S_ISDIR(status.st_mode) ? DT_DIR : S_ISREG(status.st_mode) ? DT_REG : S_ISLNK(status.st_mode) ? DT_LNK : DT_UNKNOWN;
+			}
+			if (type != DT_DIR && type != DT_REG && type != DT_LNK) {
+				continue;
+			}
+			if (is_ignored(ignore_file, path, type == DT_DIR)) {
+				continue;
+			}
+
+			if (type == DT_DIR) {
+				struct queued_directory subdirectory = {.path = memory_duplicate_string(path), .ignore_file = ignore_file};
+				if (!subdirectory.path || !push_directory(worker, subdirectory)) {
+					__atomic_store_n(&walk->failed, true, __ATOMIC_RELEASE);
+				}
+			} else if (append_string(&worker->paths, path, name_start + name_length) == SIZE_MAX) {
+				__atomic_store_n(&walk->failed, true, __ATOMIC_RELEASE);
+			}
+		}
+	}
+	close(fd);
+}
+
+static void *run_walk_worker(void *argument) {
+	struct walk_worker *worker = argument;
+	struct walk *walk = worker->walk;
+	char *dirent_buffer = memory_allocate(dirent_buffer_size);
+	if (!dirent_buffer) {
+		__atomic_store_n(&walk->failed, true, __ATOMIC_RELEASE);
+		return NULL;
+	}
+
+	struct queued_directory directory;
+	while (take_directory(worker, &directory)) {
+		if (!__atomic_load_n(&walk->failed, __ATOMIC_ACQUIRE)) {
+			read_directory(worker, &directory, dirent_buffer);
+		}
+		memory_free(directory.path);
+		pthread_mutex_lock(&walk->mutex);
+		if (--walk->pending_count == 0) {
+			pthread_cond_broadcast(&walk->condition);
+		}
+		pthread_mutex_unlock(&walk->mutex);
+	}
+	memory_free(dirent_buffer);
+	return NULL;
+}
+
+// Adds every file under `directory` (relative to the root) to the index, reading subdirectories in
+// parallel. `ignore_file` applies to the directory, and the `.gitignore` files found under it are
+// added to the browser. Returns false if memory error.
+static bool walk_directory(struct file_browser *browser, int root_fd, char *directory, struct ignore_file *ignore_file) {
+	struct walk walk = {
+		.browser = browser,
+		.worker_count = browser->thread_count,
+		.root_fd = root_fd,
+	};
+	walk.workers = memory_allocate_zeroed(walk.worker_count, sizeof *walk.workers);
+	if (!walk.workers) {
+		return false;
+	}
+	pthread_mutex_init(&walk.mutex, NULL);
+	pthread_cond_init(&walk.condition, NULL);
+
+	bool succeeded = true;
+	for (uint32_t i = 0; i < walk.worker_count; ++i) {
+		struct walk_worker *worker = walk.workers + i;
+		*worker = (struct walk_worker){.walk = &walk, .index = i};
+		pthread_mutex_init(&worker->mutex, NULL);
+		worker->directories = list_create(initial_directories_capacity, sizeof *worker->directories);
+		worker->paths = list_create(initial_paths_capacity, sizeof *worker->paths);
+		worker->directory_paths = list_create(initial_directories_capacity, sizeof *worker->directory_paths);
+		worker->ignore_files = list_create(initial_ignore_files_capacity, sizeof *worker->ignore_files);
+		if (!worker->directories || !worker->paths || !worker->directory_paths || !worker->ignore_files) {
+			succeeded = false;
+		}
+	}
+	struct queued_directory start_directory = {.path = succeeded ? memory_duplicate_string(directory) : NULL, .ignore_file = ignore_file};
+	if (!start_directory.path || !push_directory(walk.workers, start_directory)) {
+		succeeded = false;
+		goto cleanup;
+	}
+
+	// The calling thread acts as the first worker. If a thread can't be started, the others steal
+	// its share of the work.
+	uint32_t started_count = 1;
+	for (; started_count < walk.worker_count; ++started_count) {
+		if (pthread_create(&walk.workers[started_count].thread, NULL, run_walk_worker, walk.workers + started_count) != 0) {
+			break;
+		}
+	}
+	run_walk_worker(walk.workers);
+	for (uint32_t i = 1; i < started_count; ++i) {
+		pthread_join(walk.workers[i].thread, NULL);
+	}
+	succeeded = !walk.failed;
+
+	// Interning has to happen on one thread because it mutates the maps.
+	for (uint32_t i = 0; i < walk.worker_count; ++i) {
+		struct walk_worker *worker = walk.workers + i;
+		struct ignore_file *file = NULL;
+		while (list_pop_back(&worker->ignore_files, &file)) {
+			if (!succeeded || !map_add(&browser->ignore_files, file->directory, &file)) {
+				destroy_ignore_file(file);
+				succeeded = false;
+			}
+		}
+	}
+	if (!succeeded) {
+		// A `.gitignore` that was added may point to one that wasn't.
+		remove_ignore_files(browser, directory);
+	}
+	char path[PATH_MAX];
+	for (uint32_t i = 0; succeeded && i < walk.worker_count; ++i) {
+		struct walk_worker *worker = walk.workers + i;
+		size_t count = list_get_count(&worker->directory_paths);
+		for (size_t offset = 0; succeeded && offset < count;) {
+			size_t length = strlen(worker->directory_paths + offset);
+			memcpy(path, worker->directory_paths + offset, length + 1);
+			succeeded = add_directory(browser, path, length) != FILE_BROWSER_NONE;
+			offset += length + 1;
+		}
+	}
+	for (uint32_t i = 0; succeeded && i < walk.worker_count; ++i) {
+		struct walk_worker *worker = walk.workers + i;
+		// A worker records each directory's files together, so the directory is only looked up when it
+		// changes.
+		uint32_t directory_index = FILE_BROWSER_NONE;
+		size_t directory_length = 0;
+		char *directory_path = NULL;
+		size_t count = list_get_count(&worker->paths);
+		for (size_t offset = 0; succeeded && offset < count; offset += strlen(worker->paths + offset) + 1) {
+			char *file_path = worker->paths + offset;
+			char *slash = strrchr(file_path, '/');
+			size_t length = slash ? (size_t)(slash - file_path) : 0;
+			if (directory_index == FILE_BROWSER_NONE || length != directory_length || memcmp(file_path, directory_path, length) != 0) {
+				memcpy(path, file_path, length);
+				path[length] = '\0';
+				directory_index = add_directory(browser, path, length);
+				directory_length = length;
+				directory_path = file_path;
+			}
+			succeeded = directory_index != FILE_BROWSER_NONE && add_path(browser, file_path, directory_index);
+		}
+	}
+
+cleanup:
+	for (uint32_t i = 0; i < walk.worker_count; ++i) {
+		struct walk_worker *worker = walk.workers + i;
+		if (worker->directories) {
+			struct queued_directory popped_directory;
+			while (list_pop_back(&worker->directories, &popped_directory)) {
+				memory_free(popped_directory.path);
+			}
+			list_destroy(&worker->directories);
+		}
+		if (worker->ignore_files) {
+			struct ignore_file *file = NULL;
+			while (list_pop_back(&worker->ignore_files, &file)) {
+				destroy_ignore_file(file);
+			}
+			list_destroy(&worker->ignore_files);
+		}
+		if (worker->paths) {
+			list_destroy(&worker->paths);
+		}
+		if (worker->directory_paths) {
+			list_destroy(&worker->directory_paths);
+		}
+		pthread_mutex_destroy(&worker->mutex);
+	}
+	pthread_cond_destroy(&walk.condition);
+	pthread_mutex_destroy(&walk.mutex);
+	memory_free(walk.workers);
+	return succeeded;
+}
+
+// Returns true if `a` should be ranked before `b`.
+static bool match_is_better(struct file_browser *browser, struct file_match *a, struct file_match *b) {
+	if (a->score != b->score) {
+		return a->score > b->score;
+	}
+	uint32_t a_length = browser->entries[a->entry_index].path_length;
+	uint32_t b_length = browser->entries[b->entry_index].path_length;
+	if (a_length != b_length) {
+		return a_length < b_length;
+	}
+	return a->entry_index < b->entry_index;
+}
+
+// Restores the heap property of a task's matches after the match at `index` got worse.
+static void sift_down(struct search_task *task, size_t index) {
+	struct file_match *matches = task->matches;
+	size_t count = list_get_count(&task->matches);
+	while (true) {
+		size_t worst = index;
+		size_t left = 2*index + 1;
+		size_t right = 2*index + 2;
+		if (left < count && match_is_better(task->browser, matches + worst, matches + left)) {
+			worst = left;
+		}
+		if (right < count && match_is_better(task->browser, matches + worst, matches + right)) {
+			worst = right;
+		}
+		if (worst == index) {
+			return;
+		}
+		struct file_match temporary = matches[index];
+		matches[index] = matches[worst];
+		matches[worst] = temporary;
+		index = worst;
+	}
+}
+
+// Restores the heap property of a task's matches after the match at `index` got better.
+static void sift_up(struct search_task *task, size_t index) {
+	struct file_match *matches = task->matches;
+	while (index > 0) {
+		size_t parent = (index - 1)/2;
+		if (!match_is_better(task->browser, matches + parent, matches + index)) {
+			return;
+		}
+		struct file_match temporary = matches[index];
+		matches[index] = matches[parent];
+		matches[parent] = temporary;
+		index = parent;
+	}
+}
+
+static void *run_search_task(void *argument) {
+	struct search_task *task = argument;
+	struct file_browser *browser = task->browser;
+	for (uint32_t i = task->begin_index; i < task->end_index; ++i) {
+		uint32_t entry_index = task->source ? task->source[i] : i;
+		struct file_entry *entry = browser->entries + entry_index;
+		if (entry->is_removed || (task->query_mask & ~entry->character_mask)) {
+			continue;
+		}
+		int32_t score = file_browser_score(task->query, browser->paths + entry->path_index, entry->name_index);
+		if (score == INT32_MIN) {
+			continue;
+		}
+
+		if (!task->found_failed && !list_push_back(&task->found, &entry_index)) {
+			task->found_failed = true;
+		}
+		struct file_match match = {.entry_index = entry_index, .score = score};
+		size_t count = list_get_count(&task->matches);
+		if (count < task->max_matches) {
+			// The list was created with room for `max_matches`, so this can't fail.
+			list_push_back(&task->matches, &match);
+			sift_up(task, count);
+		} else if (match_is_better(browser, &match, task->matches)) {
+			task->matches[0] = match;
+			sift_down(task, 0);
+		}
+	}
+	return NULL;
+}
+
+static void *run_search_worker(void *argument) {
+	struct search_task *task = argument;
+	struct search_pool *pool = task->pool;
+	uint32_t index = task - pool->tasks;
+	uint64_t generation = 0;
+	pthread_mutex_lock(&pool->mutex);
+	while (true) {
+		while (!pool->is_stopping && pool->generation == generation) {
+			pthread_cond_wait(&pool->start_condition, &pool->mutex);
+		}
+		if (pool->is_stopping) {
+			break;
+		}
+		generation = pool->generation;
+		if (index >= pool->task_count) {
+			continue;
+		}
+		pthread_mutex_unlock(&pool->mutex);
+		run_search_task(task);
+		pthread_mutex_lock(&pool->mutex);
+		if (--pool->running_count == 0) {
+			pthread_cond_signal(&pool->done_condition);
+		}
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+// Creates the tasks and starts a worker for every task but the first. Fewer workers are fine, since
+// the searching thread scores the slices that have none. Returns false if memory error.
+static bool start_search_pool(struct file_browser *browser) {
+	struct search_pool *pool = memory_allocate_zeroed(1, sizeof *pool);
+	if (!pool) {
+		goto error1;
+	}
+	pool->tasks = memory_allocate_zeroed(browser->thread_count, sizeof *pool->tasks);
+	if (!pool->tasks) {
+		goto error2;
+	}
+	uint32_t created_count = 0;
+	for (; created_count < browser->thread_count; ++created_count) {
+		struct search_task *task = pool->tasks + created_count;
+		task->pool = pool;
+		task->matches = list_create(initial_matches_capacity, sizeof *task->matches);
+		if (!task->matches) {
+			goto error3;
+		}
+		task->found = list_create(initial_matches_capacity, sizeof *task->found);
+		if (!task->found) {
+			list_destroy(&task->matches);
+			goto error3;
+		}
+	}
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->start_condition, NULL);
+	pthread_cond_init(&pool->done_condition, NULL);
+	for (uint32_t i = 1; i < browser->thread_count; ++i) {
+		if (pthread_create(&pool->tasks[i].thread, NULL, run_search_worker, pool->tasks + i) != 0) {
+			break;
+		}
+		++pool->worker_count;
+	}
+	browser->search_pool = pool;
+	return true;
+
+error3:
+	for (uint32_t i = 0; i < created_count; ++i) {
+		list_destroy(&pool->tasks[i].matches);
+		list_destroy(&pool->tasks[i].found);
+	}
+	memory_free(pool->tasks);
+error2:
+	memory_free(pool);
+error1:
+	return false;
+}
+
+static void stop_search_pool(struct file_browser *browser) {
+	struct search_pool *pool = browser->search_pool;
+	pthread_mutex_lock(&pool->mutex);
+	pool->is_stopping = true;
+	pthread_cond_broadcast(&pool->start_condition);
+	pthread_mutex_unlock(&pool->mutex);
+	for (uint32_t i = 1; i <= pool->worker_count; ++i) {
+		pthread_join(pool->tasks[i].thread, NULL);
+	}
+	pthread_cond_destroy(&pool->done_condition);
+	pthread_cond_destroy(&pool->start_condition);
+	pthread_mutex_destroy(&pool->mutex);
+	for (uint32_t i = 0; i < browser->thread_count; ++i) {
+		list_destroy(&pool->tasks[i].matches);
+		list_destroy(&pool->tasks[i].found);
+	}
+	memory_free(pool->tasks);
+	memory_free(pool);
+	browser->search_pool = NULL;
+}
+
+// Used to sort the final matches. `qsort` has no context argument, so the browser is passed through
+// a thread-local.
+static __thread struct file_browser *sorting_browser;
+
+static int compare_matches(const void *a, const void *b) {
+	struct file_match *a_match = (struct file_match*)a;
+	struct file_match *b_match = (struct file_match*)b;
+	if (match_is_better(sorting_browser, a_match, b_match)) {
+		return -1;
+	}
+	if (match_is_better(sorting_browser, b_match, a_match)) {
+		return 1;
+	}
+	return 0;
+}
+
+// Returns true if the character at `index` starts a word: the start of the path, after a separator,
+// or a lower case to upper case change.
+static bool is_word_start(char *path, size_t index) {
+	if (index == 0) {
+		return true;
+	}
+	char previous = path[index - 1];
+	if (previous == '/' || previous == '_' || previous == '-' || previous == '.' || previous == ' ') {
+		return true;
+	}
+	return (unsigned char)(previous - 'a') < 26 && (unsigned char)(path[index] - 'A') < 26;
+}
+
+bool file_browser_initialize(struct file_browser *browser, uint32_t entries_capacity, uint32_t thread_count) {
+	*browser = (struct file_browser){.thread_count = max(1, thread_count)};
+	browser->root_path = list_create(initial_root_path_capacity, sizeof *browser->root_path);
+	if (!browser->root_path) {
+		goto error1;
+	}
+	browser->paths = list_create(initial_paths_capacity, sizeof *browser->paths);
+	if (!browser->paths) {
+		goto error2;
+	}
+	browser->entries = list_create(max(1, entries_capacity), sizeof *browser->entries);
+	if (!browser->entries) {
+		goto error3;
+	}
+	browser->entry_indices = map_create(max(16, 2*(size_t)entries_capacity), sizeof *browser->entry_indices, initial_paths_capacity);
+	if (!browser->entry_indices) {
+		goto error4;
+	}
+	browser->ignore_files = map_create(initial_ignore_files_capacity, sizeof *browser->ignore_files, initial_root_path_capacity);
+	if (!browser->ignore_files) {
+		goto error5;
+	}
+	browser->matches = list_create(initial_matches_capacity, sizeof *browser->matches);
+	if (!browser->matches) {
+		goto error6;
+	}
+	browser->query = list_create(initial_query_capacity, sizeof *browser->query);
+	if (!browser->query) {
+		goto error7;
+	}
+	browser->candidates = list_create(initial_matches_capacity, sizeof *browser->candidates);
+	if (!browser->candidates) {
+		goto error8;
+	}
+	browser->directory_paths = list_create(initial_paths_capacity, sizeof *browser->directory_paths);
+	if (!browser->directory_paths) {
+		goto error9;
+	}
+	browser->directories = list_create(initial_directories_capacity, sizeof *browser->directories);
+	if (!browser->directories) {
+		goto error10;
+	}
+	browser->directory_indices = map_create(initial_directories_capacity, sizeof *browser->directory_indices, initial_root_path_capacity);
+	if (!browser->directory_indices) {
+		goto error11;
+	}
+	if (!start_search_pool(browser)) {
+		goto error12;
+	}
+	browser->root_path[0] = '\0';
+	append_string(&browser->query, "", 0);
+	return true;
+
+error12:
+	map_destroy(&browser->directory_indices);
+error11:
+	list_destroy(&browser->directories);
+error10:
+	list_destroy(&browser->directory_paths);
+error9:
+	list_destroy(&browser->candidates);
+error8:
+	list_destroy(&browser->query);
+error7:
+	list_destroy(&browser->matches);
+error6:
+	map_destroy(&browser->ignore_files);
+error5:
+	map_destroy(&browser->entry_indices);
+error4:
+	list_destroy(&browser->entries);
+error3:
+	list_destroy(&browser->paths);
+error2:
+	list_destroy(&browser->root_path);
+error1:
+	*browser = (struct file_browser){0};
+	return false;
+}
+
+void file_browser_destroy(struct file_browser *browser) {
+	stop_search_pool(browser);
+	remove_ignore_files(browser, "");
+	map_destroy(&browser->directory_indices);
+	list_destroy(&browser->directories);
+	list_destroy(&browser->directory_paths);
+	list_destroy(&browser->candidates);
+	list_destroy(&browser->query);
+	list_destroy(&browser->matches);
+	map_destroy(&browser->ignore_files);
+	map_destroy(&browser->entry_indices);
+	list_destroy(&browser->entries);
+	list_destroy(&browser->paths);
+	list_destroy(&browser->root_path);
+	*browser = (struct file_browser){0};
+}
+
+bool file_browser_scan(struct file_browser *browser, char *root_path) {
+	list_set_count(&browser->root_path, 0);
+	if (append_string(&browser->root_path, root_path, strlen(root_path)) == SIZE_MAX || !clear_entries(browser)) {
+		return false;
+	}
+	int root_fd = open(root_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (root_fd < 0) {
+		return false;
+	}
+	remove_ignore_files(browser, "");
+	bool succeeded = walk_directory(browser, root_fd, "", NULL);
+	close(root_fd);
+	// The path keys grew by doubling while the tree was walked. Most scans are followed by small
+	// changes, so the unused half is given back.
+	return succeeded && map_trim(&browser->entry_indices) && map_trim(&browser->directory_indices);
+}
+
+bool file_browser_scan_directory(struct file_browser *browser, char *path) {
+	char parent[PATH_MAX];
+	char *slash = strrchr(path, '/');
+	size_t parent_length = slash ? (size_t)(slash - path) : 0;
+	if (parent_length >= sizeof parent) {
+		return false;
+	}
+	memcpy(parent, path, parent_length);
+	parent[parent_length] = '\0';
+	int root_fd = open(browser->root_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (root_fd < 0) {
+		return false;
+	}
+	// The directory's `.gitignore` files are read again, so the old ones would be duplicates.
+	remove_ignore_files(browser, path);
+	bool succeeded = walk_directory(browser, root_fd, path, find_ignore_file(browser, parent));
+	close(root_fd);
+	return succeeded;
+}
+
+bool file_browser_is_ignored(struct file_browser *browser, char *path, bool is_directory) {
+	char directory[PATH_MAX];
+	char *slash = strrchr(path, '/');
+	size_t directory_length = slash ? (size_t)(slash - path) : 0;
+	if (directory_length >= sizeof directory) {
+		return false;
+	}
+	memcpy(directory, path, directory_length);
+	directory[directory_length] = '\0';
+	return is_ignored(find_ignore_file(browser, directory), path, is_directory);
+}
+
+bool file_browser_add_path(struct file_browser *browser, char *path) {
+	char directory[PATH_MAX];
+	char *slash = strrchr(path, '/');
+	size_t directory_length = slash ? (size_t)(slash - path) : 0;
+	if (directory_length >= sizeof directory) {
+		return false;
+	}
+	memcpy(directory, path, directory_length);
+	directory[directory_length] = '\0';
+	uint32_t directory_index = add_directory(browser, directory, directory_length);
+	return directory_index != FILE_BROWSER_NONE && add_path(browser, path, directory_index);
+}
+
+bool file_browser_remove_path(struct file_browser *browser, char *path) {
+	uint32_t entry_index = file_browser_find_path(browser, path);
+	if (entry_index == FILE_BROWSER_NONE) {
+		return false;
+	}
+	// The entry keeps its slot and its map key so the path can come back without growing the index.
+	browser->entries[entry_index].is_removed = true;
+	++browser->removed_count;
+	return true;
+}
+
+uint32_t file_browser_remove_directory(struct file_browser *browser, char *path) {
+	uint32_t directory_index = file_browser_find_directory(browser, path);
+	uint32_t removed_count = directory_index == FILE_BROWSER_NONE ? 0 : remove_directory(browser, directory_index);
+	browser->removed_count += removed_count;
+	remove_ignore_files(browser, path);
+	return removed_count;
+}
+
+char *file_browser_get_path(struct file_browser *browser, uint32_t entry_index) {
+	return browser->paths + browser->entries[entry_index].path_index;
+}
+
+uint32_t file_browser_find_directory(struct file_browser *browser, char *path) {
+	uint32_t *directory_index = map_get(&browser->directory_indices, path);
+	if (!directory_index || browser->directories[*directory_index].is_removed) {
+		return FILE_BROWSER_NONE;
+	}
+	return *directory_index;
+}
+
+uint32_t file_browser_find_path(struct file_browser *browser, char *path) {
+	uint32_t *entry_index = map_get(&browser->entry_indices, path);
+	if (!entry_index || browser->entries[*entry_index].is_removed) {
+		return FILE_BROWSER_NONE;
+	}
+	return *entry_index;
+}
+
+int32_t file_browser_score(char *query, char *path, uint32_t name_index) {
+	size_t query_length = strlen(query);
+	if (query_length == 0) {
+		return 0;
+	}
+
+	// Find where the first match in the path ends.
+	size_t query_index = 0;
+	size_t end = 0;
+	for (size_t i = 0; path[i]; ++i) {
+		if (fold_case(path[i]) == fold_case(query[query_index])) {
+			++query_index;
+			if (query_index == query_length) {
+				end = i + 1;
+				break;
+			}
+		}
+	}
+	if (query_index < query_length) {
+		return INT32_MIN;
+	}
+
+	// Walk backward from the end to find the shortest span that still matches.
+	size_t start = end;
+	while (query_index > 0) {
+		--start;
+		if (fold_case(path[start]) == fold_case(query[query_index - 1])) {
+			--query_index;
+		}
+	}
+
+	int32_t score = 0;
+	size_t previous_index = SIZE_MAX;
+	for (size_t i = start; i < end && query_index < query_length; ++i) {
+		if (fold_case(path[i]) != fold_case(query[query_index])) {
+			continue;
+		}
+		score += match_score;
+		if (is_word_start(path, i)) {
+			score += boundary_bonus;
+		}
+		if (previous_index != SIZE_MAX && previous_index + 1 == i) {
+			score += consecutive_bonus;
+		} else if (previous_index != SIZE_MAX) {
+			score -= gap_penalty*min(i - previous_index - 1, max_penalized_gap);
+		}
+		if (i >= name_index) {
+			score += name_bonus;
+		}
+		previous_index = i;
+		++query_index;
+	}
+	return score - (int32_t)(strlen(path)/length_penalty_divisor);
+}
+
+bool file_browser_search(struct file_browser *browser, char *query, uint32_t max_matches) {
+	list_set_count(&browser->matches, 0);
+	if (max_matches == 0) {
+		return true;
+	}
+
+	// Typing usually adds to the end of the query. Every path that matches the longer query also
+	// matched the shorter one, so only the last search's candidates need to be scored.
+	size_t previous_length = list_get_count(&browser->query) - 1; // Subtracting 1 for the null terminator.
+	bool is_narrowing = browser->has_candidates && strncmp(query, browser->query, previous_length) == 0;
+	uint32_t *source = is_narrowing ? browser->candidates : NULL;
+	uint32_t item_count = is_narrowing ? list_get_count(&browser->candidates) : list_get_count(&browser->entries);
+
+	uint32_t task_count = min(browser->thread_count, max(1, item_count/min_entries_per_search_thread));
+	struct search_pool *pool = browser->search_pool;
+	struct search_task *tasks = pool->tasks;
+	uint64_t query_mask = get_character_mask(query);
+	bool succeeded = true;
+	for (uint32_t i = 0; i < task_count; ++i) {
+		struct search_task *task = tasks + i;
+		task->browser = browser;
+		task->query = query;
+		task->query_mask = query_mask;
+		task->source = source;
+		task->begin_index = (uint64_t)item_count*i/task_count;
+		task->end_index = (uint64_t)item_count*(i + 1)/task_count;
+		task->max_matches = max_matches;
+		task->found_failed = false;
+		list_set_count(&task->matches, 0);
+		list_set_count(&task->found, 0);
+		if (list_get_capacity(&task->matches) < max_matches && !list_set_capacity(&task->matches, max_matches)) {
+			succeeded = false;
+		}
+	}
+
+	if (succeeded) {
+		// The calling thread scores the first slice, and the workers the next ones.
+		uint32_t pooled_count = min(task_count, pool->worker_count + 1);
+		if (pooled_count > 1) {
+			pthread_mutex_lock(&pool->mutex);
+			pool->task_count = pooled_count;
+			pool->running_count = pooled_count - 1;
+			++pool->generation;
+			pthread_cond_broadcast(&pool->start_condition);
+			pthread_mutex_unlock(&pool->mutex);
+		}
+		run_search_task(tasks);
+		if (pooled_count > 1) {
+			pthread_mutex_lock(&pool->mutex);
+			while (pool->running_count > 0) {
+				pthread_cond_wait(&pool->done_condition, &pool->mutex);
+			}
+			pthread_mutex_unlock(&pool->mutex);
+		}
+		// Score whatever slices didn't get a worker.
+		for (uint32_t i = pooled_count; i < task_count; ++i) {
+			run_search_task(tasks + i);
+		}
+	}
+
+	// Every source entry has been read, so the candidates can be replaced in place.
+	bool has_candidates = succeeded;
+	list_set_count(&browser->candidates, 0);
+	for (uint32_t i = 0; i < task_count; ++i) {
+		size_t count = list_get_count(&tasks[i].matches);
+		for (size_t j = 0; succeeded && j < count; ++j) {
+			if (!list_push_back(&browser->matches, tasks[i].matches + j)) {
+				succeeded = false;
+			}
+		}
+		count = list_get_count(&tasks[i].found);
+		has_candidates = has_candidates && !tasks[i].found_failed;
+		for (size_t j = 0; has_candidates && j < count; ++j) {
+			if (!list_push_back(&browser->candidates, tasks[i].found + j)) {
+				has_candidates = false;
+			}
+		}
+	}
+	list_set_count(&browser->query, 0);
+	browser->has_candidates = has_candidates && append_string(&browser->query, query, strlen(query)) != SIZE_MAX;
+	if (!succeeded) {
+		list_set_count(&browser->matches, 0);
+		return false;
+	}
+
+	sorting_browser = browser;
+	qsort(browser->matches, list_get_count(&browser->matches), sizeof *browser->matches, compare_matches);
+	if (list_get_count(&browser->matches) > max_matches) {
+		list_set_count(&browser->matches, max_matches);
+	}
+	return true;
+}
+
+#undef min
+#undef max
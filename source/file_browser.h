@@ -0,0 +1,117 @@
+#ifndef FILE_BROWSER_H
+#define FILE_BROWSER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Sentinel value used in `file_browser` to indicate an entry index is invalid.
+#define FILE_BROWSER_NONE UINT32_MAX
+
+// A file found under the browser's root.
+struct file_entry {
+	uint32_t path_index; // Offset of the path in `file_browser.paths`. Relative to the root.
+	uint32_t path_length;
+	uint32_t name_index; // Offset of the file name within the path.
+	uint32_t next_index; // The next file in the same directory, or FILE_BROWSER_NONE.
+	bool is_removed; // Set when the file is gone but its slot hasn't been reused.
+	uint64_t character_mask; // Bit `n` is set if the path contains a character that maps to `n`.
+};
+
+// A directory under the browser's root. Its files and subdirectories are chained through their
+// `next_index`, so a directory's whole tree can be visited without looking at anything else.
+struct directory_entry {
+	uint32_t path_index; // Offset of the path in `file_browser.directory_paths`. Relative to the root.
+	uint32_t parent_index; // FILE_BROWSER_NONE for the root.
+	uint32_t first_file_index;
+	uint32_t first_directory_index;
+	uint32_t next_index; // The next directory with the same parent, or FILE_BROWSER_NONE.
+	bool is_removed; // Set when the directory is gone. Like files, its slot is reused if it comes back.
+};
+
+// A line from a `.gitignore` file. Matched with `fnmatch`, so `**` matches the same as `*`.
+struct ignore_pattern {
+	char *text; // Points to a list. Null terminated. Leading and trailing slashes and a leading `!` are removed.
+	bool is_directory_only; // The pattern ended with a slash.
+	bool is_anchored; // The pattern contains a slash, so it matches the path from the file's directory, not just the name.
+	bool is_negated; // The pattern started with `!`, so matching paths are kept.
+};
+
+// The patterns of one directory's `.gitignore`. The last pattern that matches a path decides whether
+// it's ignored, and a file deeper in the tree is checked before the files above it.
+struct ignore_file {
+	struct ignore_file *parent; // The nearest directory above this one with a `.gitignore`, or NULL.
+	char *directory; // Points to a list. Null terminated. Relative to the root.
+	struct ignore_pattern *patterns; // Points to a list.
+};
+
+// A result of `file_browser_search`.
+struct file_match {
+	uint32_t entry_index;
+	int32_t score;
+};
+
+// An index of every file under a directory, searchable with a fuzzy query.
+struct file_browser {
+	char *root_path; // Points to a list. Null terminated.
+	char *paths; // Points to a list. Null terminated paths stored back to back.
+	char *directory_paths; // Points to a list. Null terminated paths of every directory, back to back.
+	struct file_entry *entries; // Points to a list.
+	uint32_t *entry_indices; // Points to a map. Maps each path to its index in `entries`.
+	struct directory_entry *directories; // Points to a list.
+	uint32_t *directory_indices; // Points to a map. Maps each directory's path to its index in `directories`.
+	struct ignore_file **ignore_files; // Points to a map. Maps each directory with a `.gitignore` to its patterns.
+	struct file_match *matches; // Points to a list. Sorted best first.
+	char *query; // Points to a list. Null terminated. The query of the last search.
+	uint32_t *candidates; // Points to a list. Every entry that matched `query`.
+	bool has_candidates; // False if `candidates` is out of date.
+	uint32_t removed_count;
+	uint32_t thread_count;
+	struct search_pool *search_pool; // The threads that score a search, started once by `file_browser_initialize`.
+};
+
+bool file_browser_initialize(struct file_browser *browser, uint32_t entries_capacity, uint32_t thread_count);
+
+void file_browser_destroy(struct file_browser *browser);
+
+// Replaces the index with every file under `root_path`. Directories are read in parallel and
+// anything matching a `.gitignore` is skipped, along with `.git` directories. A `.gitignore` is only
+// read when its directory is, so editing one takes effect on the next scan. Returns false if memory
+// or IO error.
+bool file_browser_scan(struct file_browser *browser, char *root_path);
+
+// Adds every file under `path` (relative to the root) to the index, reading the `.gitignore` files
+// under it again. Used when a directory appears after the scan. Returns false if memory or IO error.
+bool file_browser_scan_directory(struct file_browser *browser, char *path);
+
+// Returns true if `path` (relative to the root) should be left out of the index.
+bool file_browser_is_ignored(struct file_browser *browser, char *path, bool is_directory);
+
+// Adds `path` (relative to the root) to the index if it isn't already there. Returns false if memory
+// error.
+bool file_browser_add_path(struct file_browser *browser, char *path);
+
+// Marks `path` (relative to the root) as removed. Returns false if it wasn't in the index.
+bool file_browser_remove_path(struct file_browser *browser, char *path);
+
+// Marks every file under `path` (relative to the root) as removed and forgets the `.gitignore` files
+// under it. Returns how many files were removed.
+uint32_t file_browser_remove_directory(struct file_browser *browser, char *path);
+
+char *file_browser_get_path(struct file_browser *browser, uint32_t entry_index);
+
+// Returns the index in `browser->directories` of the directory at `path` (relative to the root), or
+// FILE_BROWSER_NONE if it isn't in the index.
+uint32_t file_browser_find_directory(struct file_browser *browser, char *path);
+
+// Returns FILE_BROWSER_NONE if the path isn't in the index.
+uint32_t file_browser_find_path(struct file_browser *browser, char *path);
+
+// Scores how well `query` fuzzy matches `path`. Higher is better. Returns INT32_MIN if the query's
+// characters don't appear in the path in order.
+int32_t file_browser_score(char *query, char *path, uint32_t name_index);
+
+// Fills `browser->matches` with the best `max_matches` entries for `query`, best first. Returns false
+// if memory error.
+bool file_browser_search(struct file_browser *browser, char *query, uint32_t max_matches);
+
+#endif // FILE_BROWSER_H
@@ -0,0 +1,452 @@
+#define MEMORY_SUBSYSTEM MEMORY_SUBSYSTEM_JOURNAL
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "journal.h"
+#include "buffer.h"
+#include "list.h"
+#include "replace.h"
+
+#define max(a, b) (((a) >= (b)) ? (a) : (b))
+
+// The start of every journal file. Ties the journal to the version of the file it was written for.
+struct journal_header {
+	char magic[4];
+	uint32_t version;
+	uint64_t file_size;
+	uint64_t file_inode;
+	int64_t file_modified_seconds;
+	int64_t file_modified_nanoseconds;
+};
+
+// The first byte of a record's payload.
+enum journal_record_type {
+	JOURNAL_RECORD_INSERT = 1, // Followed by y, x, then the inserted text up to the end of the payload.
+	JOURNAL_RECORD_DELETE = 2, // Followed by start y, start x, end y, end x.
+	JOURNAL_RECORD_REPLACE = 3, // Followed by the pattern's length, the pattern, then the replacement text up to the end of the payload.
+};
+
+static const char journal_magic[4] = {'J', 'R', 'N', 'L'};
+
+static const uint32_t journal_version = 1;
+
+static const size_t initial_pending_capacity = 64*1024;
+
+// The longest encoding of a 32 bit integer.
+static const size_t max_varint_size = 5;
+
+static const size_t checksum_size = 4;
+
+// Returns how many bytes `value` takes as a varint.
+static size_t get_varint_size(uint32_t value) {
+	size_t size = 1;
+	while (value >= 0x80) {
+		value >>= 7;
+		++size;
+	}
+	return size;
+}
+
+// Writes `value` 7 bits at a time, low bits first. The high bit of each byte is set if more follow.
+// Returns a pointer past the last byte written.
+static char8 *write_varint(char8 *destination, uint32_t value) {
+	while (value >= 0x80) {
+		*destination++ = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	*destination++ = value;
+	return destination;
+}
+
+// Returns false if the varint runs past `end` or is too long.
+static bool read_varint(char8 **source, char8 *end, uint32_t *value) {
+	*value = 0;
+	for (size_t i = 0; i < max_varint_size && *source < end; ++i) {
+		char8 byte = *(*source)++;
+		*value |= (uint32_t)(byte & 0x7f) << (7*i);
+		if (!(byte & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// FNV-1a, 32 bit. Detects records that were only partly written before a crash.
+static uint32_t get_checksum(char8 *data, size_t size) {
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash^data[i])*16777619u;
+	}
+	return hash;
+}
+
+static bool write_all(int fd, char8 *data, size_t size) {
+	while (size) {
+		ssize_t written = write(fd, data, size);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+// Writes a header describing the file as it is now. The journal file must be empty.
+static bool write_header(struct journal *journal) {
+	struct journal_header header = {.version = journal_version};
+	memcpy(header.magic, journal_magic, sizeof header.magic);
+	struct stat status;
+	if (stat(journal->buffer->file_path, &status) == 0) {
+		header.file_size = status.st_size;
+		header.file_inode = status.st_ino;
+		header.file_modified_seconds = status.st_mtim.tv_sec;
+		header.file_modified_nanoseconds = status.st_mtim.tv_nsec;
+	}
+	return write_all(journal->fd, (char8*)&header, sizeof header) && fdatasync(journal->fd) == 0;
+}
+
+// Reserves room for a record with a payload of `payload_size` bytes at the end of the pending
+// records. Must be called with the mutex held. Returns a pointer to the payload, or NULL if memory
+// error.
+static char8 *begin_record(struct journal *journal, size_t payload_size) {
+	size_t record_size = get_varint_size(payload_size) + payload_size + checksum_size;
+	size_t count = list_get_count(&journal->pending);
+	size_t capacity = list_get_capacity(&journal->pending);
+	if (count + record_size > capacity && !list_set_capacity(&journal->pending, max(count + record_size, list_growth_factor*capacity))) {
+		return NULL;
+	}
+	list_set_count(&journal->pending, count + record_size);
+	return write_varint(journal->pending + count, payload_size);
+}
+
+// Writes the checksum after a payload and wakes up the background thread. Must be called with the
+// mutex held.
+static void end_record(struct journal *journal, char8 *payload, size_t payload_size) {
+	uint32_t checksum = get_checksum(payload, payload_size);
+	char8 *destination = payload + payload_size;
+	for (size_t i = 0; i < checksum_size; ++i) {
+		destination[i] = checksum >> (8*i);
+	}
+	journal->appended_size += get_varint_size(payload_size) + payload_size + checksum_size;
+	++journal->record_count;
+	pthread_cond_signal(&journal->pending_condition);
+}
+
+// The background thread. Writes whatever records have piled up and syncs them all at once.
+static void *run_journal(void *argument) {
+	struct journal *journal = argument;
+	pthread_mutex_lock(&journal->mutex);
+	while (true) {
+		while (!journal->is_closing && list_is_empty(&journal->pending)) {
+			pthread_cond_wait(&journal->pending_condition, &journal->mutex);
+		}
+		if (list_is_empty(&journal->pending)) {
+			break;
+		}
+
+		// Give the next few keystrokes a chance to share this sync. Closing or flushing doesn't wait.
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += (long)journal->commit_delay_milliseconds*1000000;
+		deadline.tv_sec += deadline.tv_nsec/1000000000;
+		deadline.tv_nsec %= 1000000000;
+		while (!journal->is_closing && !journal->is_flush_requested) {
+			if (pthread_cond_timedwait(&journal->pending_condition, &journal->mutex, &deadline) == ETIMEDOUT) {
+				break;
+			}
+		}
+		journal->is_flush_requested = false;
+
+		// Swap the lists so records can keep being appended while these are written.
+		char8 *writing = journal->pending;
+		journal->pending = journal->writing;
+		journal->writing = writing;
+		uint64_t target_size = journal->appended_size;
+		pthread_mutex_unlock(&journal->mutex);
+
+		bool succeeded = write_all(journal->fd, journal->writing, list_get_count(&journal->writing)) && fdatasync(journal->fd) == 0;
+		list_set_count(&journal->writing, 0);
+
+		pthread_mutex_lock(&journal->mutex);
+		journal->failed = journal->failed || !succeeded;
+		journal->durable_size = target_size;
+		pthread_cond_broadcast(&journal->durable_condition);
+	}
+	pthread_mutex_unlock(&journal->mutex);
+	return NULL;
+}
+
+// Applies one record's payload to the buffer. Returns false if the payload is malformed.
+static bool replay_record(struct buffer *buffer, char8 *payload, char8 *end) {
+	if (payload == end) {
+		return false;
+	}
+	enum journal_record_type type = *payload++;
+	if (type == JOURNAL_RECORD_INSERT) {
+		struct mark mark;
+		if (!read_varint(&payload, end, &mark.y) || !read_varint(&payload, end, &mark.x)) {
+			return false;
+		}
+		return buffer_insert_text(buffer, mark, payload, end - payload, NULL);
+	}
+	if (type == JOURNAL_RECORD_DELETE) {
+		struct selection selection;
+		if (!read_varint(&payload, end, &selection.start.y) || !read_varint(&payload, end, &selection.start.x)) {
+			return false;
+		}
+		if (!read_varint(&payload, end, &selection.end.y) || !read_varint(&payload, end, &selection.end.x)) {
+			return false;
+		}
+		return payload == end && buffer_delete_text(buffer, selection);
+	}
+	if (type == JOURNAL_RECORD_REPLACE) {
+		uint32_t pattern_length = 0;
+		if (!read_varint(&payload, end, &pattern_length) || (size_t)(end - payload) < pattern_length) {
+			return false;
+		}
+		struct replacement replacement;
+		char8 *text = payload + pattern_length;
+		if (!replace_all(&replacement, buffer, NULL, payload, pattern_length, text, end - text, 1)) {
+			return false;
+		}
+		replacement_destroy(&replacement);
+		return true;
+	}
+	return false;
+}
+
+bool journal_get_path(char *file_path, char *journal_path, size_t size) {
+	char *name = strrchr(file_path, '/');
+	int directory_length = name ? name - file_path + 1 : 0;
+	name = name ? name + 1 : file_path;
+	int length = snprintf(journal_path, size, "%.*s.%s.journal", directory_length, file_path, name);
+	return length >= 0 && (size_t)length < size;
+}
+
+bool journal_open(struct journal *journal, struct buffer *buffer, char *journal_path, uint32_t commit_delay_milliseconds) {
+	*journal = (struct journal){
+		.buffer = buffer,
+		.commit_delay_milliseconds = commit_delay_milliseconds,
+	};
+	journal->fd = open(journal_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+	if (journal->fd < 0) {
+		goto error1;
+	}
+	if (!write_header(journal)) {
+		goto error2;
+	}
+	journal->pending = list_create(initial_pending_capacity, sizeof *journal->pending);
+	if (!journal->pending) {
+		goto error2;
+	}
+	journal->writing = list_create(initial_pending_capacity, sizeof *journal->writing);
+	if (!journal->writing) {
+		goto error3;
+	}
+	pthread_mutex_init(&journal->mutex, NULL);
+	pthread_cond_init(&journal->pending_condition, NULL);
+	pthread_cond_init(&journal->durable_condition, NULL);
+	if (pthread_create(&journal->thread, NULL, run_journal, journal) != 0) {
+		goto error4;
+	}
+	buffer->journal = journal;
+	return true;
+
+error4:
+	pthread_cond_destroy(&journal->durable_condition);
+	pthread_cond_destroy(&journal->pending_condition);
+	pthread_mutex_destroy(&journal->mutex);
+	list_destroy(&journal->writing);
+error3:
+	list_destroy(&journal->pending);
+error2:
+	close(journal->fd);
+	unlink(journal_path);
+error1:
+	*journal = (struct journal){.fd = -1};
+	return false;
+}
+
+void journal_close(struct journal *journal, char *journal_path, bool keep_file) {
+	pthread_mutex_lock(&journal->mutex);
+	journal->is_closing = true;
+	pthread_cond_signal(&journal->pending_condition);
+	pthread_mutex_unlock(&journal->mutex);
+	pthread_join(journal->thread, NULL);
+
+	close(journal->fd);
+	if (!keep_file || journal->record_count == 0) {
+		unlink(journal_path);
+	}
+	if (journal->buffer->journal == journal) {
+		journal->buffer->journal = NULL;
+	}
+	pthread_cond_destroy(&journal->durable_condition);
+	pthread_cond_destroy(&journal->pending_condition);
+	pthread_mutex_destroy(&journal->mutex);
+	list_destroy(&journal->writing);
+	list_destroy(&journal->pending);
+	*journal = (struct journal){.fd = -1};
+}
+
+bool journal_record_insert(struct journal *journal, struct mark mark, char8 *text, uint32_t length) {
+	size_t payload_size = 1 + get_varint_size(mark.y) + get_varint_size(mark.x) + length;
+	pthread_mutex_lock(&journal->mutex);
+	char8 *payload = begin_record(journal, payload_size);
+	if (!payload) {
+		pthread_mutex_unlock(&journal->mutex);
+		return false;
+	}
+	char8 *destination = payload;
+	*destination++ = JOURNAL_RECORD_INSERT;
+	destination = write_varint(destination, mark.y);
+	destination = write_varint(destination, mark.x);
+	memcpy(destination, text, length);
+	end_record(journal, payload, payload_size);
+	pthread_mutex_unlock(&journal->mutex);
+	return true;
+}
+
+bool journal_record_delete(struct journal *journal, struct selection selection) {
+	size_t payload_size = 1 + get_varint_size(selection.start.y) + get_varint_size(selection.start.x) + get_varint_size(selection.end.y) + get_varint_size(selection.end.x);
+	pthread_mutex_lock(&journal->mutex);
+	char8 *payload = begin_record(journal, payload_size);
+	if (!payload) {
+		pthread_mutex_unlock(&journal->mutex);
+		return false;
+	}
+	char8 *destination = payload;
+	*destination++ = JOURNAL_RECORD_DELETE;
+	destination = write_varint(destination, selection.start.y);
+	destination = write_varint(destination, selection.start.x);
+	destination = write_varint(destination, selection.end.y);
+	destination = write_varint(destination, selection.end.x);
+	end_record(journal, payload, payload_size);
+	pthread_mutex_unlock(&journal->mutex);
+	return true;
+}
+
+bool journal_record_replace(struct journal *journal, char8 *pattern, uint32_t pattern_length, char8 *text, uint32_t text_length) {
+	size_t payload_size = 1 + get_varint_size(pattern_length) + pattern_length + text_length;
+	pthread_mutex_lock(&journal->mutex);
+	char8 *payload = begin_record(journal, payload_size);
+	if (!payload) {
+		pthread_mutex_unlock(&journal->mutex);
+		return false;
+	}
+	char8 *destination = payload;
+	*destination++ = JOURNAL_RECORD_REPLACE;
+	destination = write_varint(destination, pattern_length);
+	memcpy(destination, pattern, pattern_length);
+	memcpy(destination + pattern_length, text, text_length);
+	end_record(journal, payload, payload_size);
+	pthread_mutex_unlock(&journal->mutex);
+	return true;
+}
+
+bool journal_flush(struct journal *journal) {
+	pthread_mutex_lock(&journal->mutex);
+	uint64_t target_size = journal->appended_size;
+	if (journal->durable_size < target_size) {
+		journal->is_flush_requested = true;
+		pthread_cond_signal(&journal->pending_condition);
+	}
+	while (journal->durable_size < target_size && !journal->failed) {
+		pthread_cond_wait(&journal->durable_condition, &journal->mutex);
+	}
+	bool succeeded = !journal->failed;
+	pthread_mutex_unlock(&journal->mutex);
+	return succeeded;
+}
+
+bool journal_reset(struct journal *journal) {
+	// Records that failed to write don't matter anymore, since the saved file has their edits, but the
+	// background thread has to be done with the file before it's truncated. Only the editing thread
+	// appends records, so the background thread stays idle until this returns.
+	pthread_mutex_lock(&journal->mutex);
+	if (journal->durable_size < journal->appended_size) {
+		journal->is_flush_requested = true;
+		pthread_cond_signal(&journal->pending_condition);
+	}
+	while (journal->durable_size < journal->appended_size) {
+		pthread_cond_wait(&journal->durable_condition, &journal->mutex);
+	}
+	bool succeeded = ftruncate(journal->fd, 0) == 0 && write_header(journal);
+	journal->record_count = 0;
+	// Once the new header is on disk the journal is whole again, so an earlier failure is forgotten.
+	journal->failed = !succeeded;
+	pthread_mutex_unlock(&journal->mutex);
+	return succeeded;
+}
+
+bool journal_recover(struct buffer *buffer, char *file_path, char *journal_path) {
+	int fd = open(journal_path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat journal_status;
+	if (fstat(fd, &journal_status) != 0 || (size_t)journal_status.st_size < sizeof(struct journal_header)) {
+		close(fd);
+		return false;
+	}
+	char8 *data = mmap(NULL, journal_status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+
+	struct journal_header header;
+	memcpy(&header, data, sizeof header);
+	struct stat file_status;
+	bool succeeded = memcmp(header.magic, journal_magic, sizeof header.magic) == 0
+		&& header.version == journal_version
+		&& stat(file_path, &file_status) == 0
+		&& header.file_size == (uint64_t)file_status.st_size
+		&& header.file_inode == (uint64_t)file_status.st_ino
+		&& header.file_modified_seconds == file_status.st_mtim.tv_sec
+		&& header.file_modified_nanoseconds == file_status.st_mtim.tv_nsec
+		&& buffer_load_file(buffer, file_path);
+	if (!succeeded) {
+		munmap(data, journal_status.st_size);
+		return false;
+	}
+
+	// Replayed edits mustn't be journaled again.
+	struct journal *journal = buffer->journal;
+	buffer->journal = NULL;
+	char8 *end = data + journal_status.st_size;
+	char8 *record = data + sizeof header;
+	while (record < end) {
+		uint32_t payload_size = 0;
+		if (!read_varint(&record, end, &payload_size) || (size_t)(end - record) < payload_size + checksum_size) {
+			break;
+		}
+		char8 *payload = record;
+		record += payload_size + checksum_size;
+		uint32_t checksum = 0;
+		for (size_t i = 0; i < checksum_size; ++i) {
+			checksum |= (uint32_t)payload[payload_size + i] << (8*i);
+		}
+		if (checksum != get_checksum(payload, payload_size) || !replay_record(buffer, payload, payload + payload_size)) {
+			break;
+		}
+	}
+	buffer->journal = journal;
+	munmap(data, journal_status.st_size);
+	return true;
+}
+
+#undef max
@@ -0,0 +1,65 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "buffer.h"
+
+// An append-only file of the edits made to a buffer since it was last saved. After a crash, the
+// buffer can be rebuilt from the saved file and the journal with `journal_recover`.
+//
+// Edits are encoded on the editing thread and handed to a background thread, which writes whatever
+// has piled up and syncs it to disk with a single `fdatasync`.
+struct journal {
+	struct buffer *buffer;
+	int fd;
+	pthread_t thread;
+	pthread_mutex_t mutex; // Guards every field below.
+	pthread_cond_t pending_condition; // Signaled when records are added or the journal is closing.
+	pthread_cond_t durable_condition; // Signaled after each sync.
+	char8 *pending; // Points to a list. Encoded records that haven't been written yet.
+	char8 *writing; // Points to a list. The records being written. Only used by the background thread.
+	uint64_t appended_size; // Bytes of records appended since the journal was opened.
+	uint64_t durable_size; // Bytes of records known to be on disk.
+	uint32_t record_count; // Records since the last save.
+	uint32_t commit_delay_milliseconds; // How long to wait for more records before syncing.
+	bool is_closing;
+	bool is_flush_requested; // Makes the background thread sync without waiting for more records.
+	bool failed; // Set if a write or sync failed. Records after that may be lost.
+};
+
+// Returns the conventional journal path for a file: `.name.journal` in the same directory. Returns
+// false if the path doesn't fit in `size` bytes.
+bool journal_get_path(char *file_path, char *journal_path, size_t size);
+
+// Starts a new journal for the buffer's file, replacing any journal already at `journal_path`, and
+// attaches it to the buffer. Returns false if memory or IO error.
+bool journal_open(struct journal *journal, struct buffer *buffer, char *journal_path, uint32_t commit_delay_milliseconds);
+
+// Writes everything pending, stops the background thread, and detaches the journal from its buffer.
+// The file is removed if there were no edits since the last save, or if `keep_file` is false.
+void journal_close(struct journal *journal, char *journal_path, bool keep_file);
+
+// Returns false if memory error.
+bool journal_record_insert(struct journal *journal, struct mark mark, char8 *text, uint32_t length);
+
+// Returns false if memory error.
+bool journal_record_delete(struct journal *journal, struct selection selection);
+
+// Records a whole `replace_all` as one record. Returns false if memory error.
+bool journal_record_replace(struct journal *journal, char8 *pattern, uint32_t pattern_length, char8 *text, uint32_t text_length);
+
+// Blocks until every record appended so far is on disk. Returns false if IO error.
+bool journal_flush(struct journal *journal);
+
+// Empties the journal after the buffer was saved, so it describes edits to the new file. Clears an
+// earlier write failure once the empty journal is on disk. Returns false if IO error.
+bool journal_reset(struct journal *journal);
+
+// Loads `file_path` into the buffer and replays the journal's edits on top of it. A record cut off
+// by a crash ends the replay. Returns false if the journal doesn't belong to the file as it is on
+// disk, or if memory or IO error.
+bool journal_recover(struct buffer *buffer, char *file_path, char *journal_path);
+
+#endif // JOURNAL_H
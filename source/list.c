@@ -1,13 +1,16 @@
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include "list.h"
+#include "memory.h"
 
 struct list_header {
 	size_t buckets_capacity;
 	size_t buckets_count;
-	size_t bucket_size;
+	uint32_t bucket_size; // 32 bits, so the subsystem fits without growing every list's header.
+	enum memory_subsystem subsystem;
 	char buckets[];
 };
 
@@ -17,7 +20,7 @@ static struct list_header *get_header(void **list) {
 	return (struct list_header*)*list - 1;
 }
 
-void *list_create(size_t capacity, size_t bucket_size) {
+void *list_create_impl(size_t capacity, size_t bucket_size, enum memory_subsystem subsystem) {
 	struct list_header *header = malloc(sizeof *header + capacity*bucket_size);
 	if (!header) {
 		return NULL;
@@ -25,12 +28,15 @@ void *list_create(size_t capacity, size_t bucket_size) {
 	*header = (struct list_header){
 		.buckets_capacity = capacity,
 		.bucket_size = bucket_size,
+		.subsystem = subsystem,
 	};
+	memory_count(header->subsystem, 0, sizeof *header + capacity*bucket_size);
 	return &header->buckets;
 }
 
 void list_destroy_impl(void **list) {
 	struct list_header *header = get_header(list);
+	memory_count(header->subsystem, sizeof *header + header->buckets_capacity*header->bucket_size, 0);
 	free(header);
 	*list = NULL;
 }
@@ -45,15 +51,22 @@ bool list_set_capacity_impl(void **list, size_t capacity) {
 	if (capacity < header->buckets_count) {
 		header->buckets_count = capacity;
 	}
+	size_t old_size = sizeof *header + header->buckets_capacity*header->bucket_size;
 	header = realloc(header, sizeof *header + capacity*header->bucket_size);
 	if (!header) {
 		return false;
 	}
+	memory_count(header->subsystem, old_size, sizeof *header + capacity*header->bucket_size);
 	header->buckets_capacity = capacity;
 	*list = &header->buckets;
 	return true;
 }
 
+size_t list_get_allocated_size_impl(void **list) {
+	struct list_header *header = get_header(list);
+	return sizeof *header + header->buckets_capacity*header->bucket_size;
+}
+
 size_t list_get_count_impl(void **list) {
 	struct list_header *header = get_header(list);
 	return header->buckets_count;
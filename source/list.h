@@ -3,6 +3,10 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include "memory.h"
+
+// The list's memory is counted against the subsystem of the source file that calls this.
+#define list_create(capacity, bucket_size) (list_create_impl((capacity), (bucket_size), MEMORY_SUBSYSTEM))
 
 #define list_destroy(list) (list_destroy_impl((void**)(list)))
 
@@ -12,6 +16,9 @@
 // count, the count of the list shrinks to the new capacity.
 #define list_set_capacity(list, capacity) (list_set_capacity_impl((void**)(list), (capacity)))
 
+// Returns how many bytes the list takes, counting its header and unused capacity.
+#define list_get_allocated_size(list) (list_get_allocated_size_impl((void**)(list)))
+
 #define list_get_count(list) (list_get_count_impl((void**)(list)))
 
 // Returns true if the new count was <= the list's capacity, returns false and does nothing
@@ -36,7 +43,7 @@
 
 extern const size_t list_growth_factor;
 
-void *list_create(size_t capacity, size_t bucket_size);
+void *list_create_impl(size_t capacity, size_t bucket_size, enum memory_subsystem subsystem);
 
 void list_destroy_impl(void **list);
 
@@ -44,6 +51,8 @@ size_t list_get_capacity_impl(void **list);
 
 bool list_set_capacity_impl(void **list, size_t capacity);
 
+size_t list_get_allocated_size_impl(void **list);
+
 size_t list_get_count_impl(void **list);
 
 bool list_set_count_impl(void **list, size_t count);
@@ -1,7 +1,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <ncurses.h>
-#include "buffer.h"
+#include "editor.h"
 
 void setup_ncurses(void) {
 	initscr();
@@ -15,6 +15,22 @@ void teardown_ncurses(void) {
 	endwin();
 }
 
-int main(void) {
+int main(int argument_count, char **arguments) {
+	setup_ncurses();
+	struct editor editor;
+	if (!editor_initialize(&editor)) {
+		teardown_ncurses();
+		fprintf(stderr, "Couldn't start the editor.\n");
+		return 1;
+	}
+	if (argument_count > 1 && !editor_open_file(&editor, arguments[1])) {
+		editor_print(&editor, "Couldn't open the file.");
+	}
+	editor_draw(&editor);
+	while (editor.is_running) {
+		editor_update(&editor);
+	}
+	editor_destroy(&editor);
+	teardown_ncurses();
 	return 0;
 }
@@ -1,19 +1,25 @@
 #include <stdio.h>
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include "map.h"
+#include "memory.h"
 
 #define max(a, b) (((a) >= (b)) ? (a) : (b))
 
 struct map_header {
 	size_t keys_capacity;
 	size_t keys_size;
+	size_t removed_keys_size; // Bytes in `keys` used by keys that were removed.
 	char *keys;
 	size_t buckets_capacity;
 	size_t buckets_count;
-	size_t bucket_size;
+	size_t removed_count; // Buckets whose key was removed and that haven't been reused.
+	uint32_t bucket_size; // 32 bits, so the subsystem fits without padding before `buckets`.
+	enum memory_subsystem subsystem;
 	size_t *key_indices; // Same capacity as `buckets`.
 	char buckets[];
 };
@@ -27,6 +33,15 @@ enum probe_result {
 
 static const size_t initial_keys_capacity = 1024;
 
+// Marks a bucket whose key was removed. Probing continues past these, unlike empty buckets.
+static const size_t removed_key_index = SIZE_MAX;
+
+// The map is rebuilt once `(buckets_count + removed_count)/buckets_capacity` would exceed this
+// fraction. Removed buckets count because probes walk past them. Keeping some buckets empty keeps
+// probe sequences short.
+static const size_t max_load_numerator = 3;
+static const size_t max_load_denominator = 4;
+
 const size_t buckets_growth_factor = 2;
 
 const size_t keys_growth_factor = 2;
@@ -54,12 +69,19 @@ static enum probe_result probe(void **map, char *key, size_t *bucket_index) {
 	struct map_header *header = get_header(map);
 	size_t start_index = hash(key)%header->buckets_capacity;
 	size_t index = start_index;
-	size_t next_empty_index = 0;
+	size_t next_empty_index = SIZE_MAX;
 
 	// Look for a matching key or an empty bucket.
 	do {
 		if (header->key_indices[index] == 0) {
-			if (next_empty_index == 0) {
+			// A bucket that has never been used ends the probe sequence, the key can't be past it.
+			if (next_empty_index == SIZE_MAX) {
+				next_empty_index = index;
+			}
+			break;
+		} else if (header->key_indices[index] == removed_key_index) {
+			// Removed buckets can be reused, but the key might still be further along.
+			if (next_empty_index == SIZE_MAX) {
 				next_empty_index = index;
 			}
 		// If the bucket is full and the key matches, we found the bucket.
@@ -71,7 +93,7 @@ static enum probe_result probe(void **map, char *key, size_t *bucket_index) {
 		index = (index + 1)%header->buckets_capacity;
 	} while (index != start_index);
 
-	if (header->buckets_count < header->buckets_capacity) {
+	if (next_empty_index != SIZE_MAX) {
 		*bucket_index = next_empty_index;
 		return PROBE_RESULT_MAP_NOT_FULL;
 	}
@@ -79,6 +101,11 @@ static enum probe_result probe(void **map, char *key, size_t *bucket_index) {
 	return PROBE_RESULT_MAP_FULL;
 }
 
+// Returns true if the bucket at `index` holds a value.
+static bool bucket_is_full(struct map_header *header, size_t index) {
+	return header->key_indices[index] != 0 && header->key_indices[index] != removed_key_index;
+}
+
 // Returns the index of the key in the string pool if successful, 0 otherwise.
 static size_t add_key(void **map, char *key) {
 	struct map_header *header = get_header(map);
@@ -97,7 +124,7 @@ static size_t add_key(void **map, char *key) {
 	return previous_size + 1; // Adding 1 because 0 is a sentinal value meaning an empty bucket.
 }
 
-void *map_create(size_t buckets_capacity, size_t bucket_size, size_t keys_capacity) {
+void *map_create_impl(size_t buckets_capacity, size_t bucket_size, size_t keys_capacity, enum memory_subsystem subsystem) {
 	struct map_header *header = malloc(sizeof *header + buckets_capacity*bucket_size);
 	if (!header) {
 		return NULL;
@@ -107,6 +134,7 @@ void *map_create(size_t buckets_capacity, size_t bucket_size, size_t keys_capaci
 		.keys = malloc(keys_capacity),
 		.buckets_capacity = buckets_capacity,
 		.bucket_size = bucket_size,
+		.subsystem = subsystem,
 	};
 	if (!header->keys) {
 		free(header);
@@ -115,14 +143,20 @@ void *map_create(size_t buckets_capacity, size_t bucket_size, size_t keys_capaci
 	header->key_indices = calloc(buckets_capacity, sizeof *header->key_indices);
 	if (!header->key_indices) {
 		free(header->keys);
-		free(header->key_indices);
+		free(header);
 		return NULL;
 	}
+	memory_count(header->subsystem, 0, sizeof *header + buckets_capacity*bucket_size);
+	memory_count(header->subsystem, 0, keys_capacity);
+	memory_count(header->subsystem, 0, buckets_capacity*sizeof *header->key_indices);
 	return &header->buckets;
 }
 
 void map_destroy_impl(void **map) {
 	struct map_header *header = get_header(map);
+	memory_count(header->subsystem, header->keys_capacity, 0);
+	memory_count(header->subsystem, header->buckets_capacity*sizeof *header->key_indices, 0);
+	memory_count(header->subsystem, sizeof *header + header->buckets_capacity*header->bucket_size, 0);
 	free(header->keys);
 	free(header->key_indices);
 	free(header);
@@ -134,23 +168,18 @@ size_t map_get_buckets_capacity_impl(void **map) {
 	return header->buckets_capacity;
 }
 
-bool map_set_buckets_capacity_impl(void **map, size_t capacity) {
+// Moves every entry to a new map with the given capacities. Keys of removed entries aren't copied.
+// Returns false if memory error.
+static bool rebuild(void **map, size_t buckets_capacity, size_t keys_capacity) {
 	struct map_header *header = get_header(map);
-	if (capacity < header->buckets_count) {
-		return false;
-	}
-	if (capacity == header->buckets_capacity) {
-		return true;
-	}
-	
-	void *new_map = map_create(capacity, header->bucket_size, initial_keys_capacity);
+	void *new_map = map_create_impl(buckets_capacity, header->bucket_size, keys_capacity, header->subsystem);
 	if (!new_map) {
 		return false;
 	}
 
 	// Rehash all of the values from the old map.
 	for (size_t i = 0; i < header->buckets_capacity; ++i) {
-		if (header->key_indices[i]) {
+		if (bucket_is_full(header, i)) {
 			char *key = header->keys + header->key_indices[i] - 1; // Subtracting 1 because key indices are offset by +1.
 			void *value = header->buckets + i*header->bucket_size;
 			if (!map_add(&new_map, key, value)) {
@@ -166,6 +195,17 @@ bool map_set_buckets_capacity_impl(void **map, size_t capacity) {
 	return true;
 }
 
+bool map_set_buckets_capacity_impl(void **map, size_t capacity) {
+	struct map_header *header = get_header(map);
+	if (capacity < header->buckets_count) {
+		return false;
+	}
+	if (capacity == header->buckets_capacity) {
+		return true;
+	}
+	return rebuild(map, capacity, initial_keys_capacity);
+}
+
 size_t map_get_buckets_count_impl(void **map) {
 	struct map_header *header = get_header(map);
 	return header->buckets_count;
@@ -190,6 +230,7 @@ bool map_set_keys_capacity_impl(void **map, size_t capacity) {
 	if (!new_keys) {
 		return false;
 	}
+	memory_count(header->subsystem, header->keys_capacity, capacity);
 	header->keys_capacity = capacity;
 	header->keys = new_keys;
 	return true;
@@ -221,7 +262,6 @@ bool map_set_impl(void **map, char *key, void *value) {
 	enum probe_result result = probe(map, key, &bucket_index);
 	if (result == PROBE_RESULT_KEY_FOUND) {
 		memcpy(header->buckets + bucket_index*header->bucket_size, value, header->bucket_size);
-		++header->buckets_count;
 		return true;
 	}
 	return false;
@@ -231,11 +271,20 @@ bool map_add_impl(void **map, char *key, void *value) {
 	struct map_header *header = get_header(map);
 	size_t bucket_index = 0;
 	enum probe_result result = probe(map, key, &bucket_index);
-	if (result == PROBE_RESULT_MAP_FULL) {
-		if (!map_set_buckets_capacity_impl(map, header->buckets_capacity*buckets_growth_factor)) {
+	// Reusing a removed bucket doesn't add to the load.
+	bool is_reused = result == PROBE_RESULT_MAP_NOT_FULL && header->key_indices[bucket_index] == removed_key_index;
+	bool over_load = (header->buckets_count + header->removed_count + 1)*max_load_denominator > header->buckets_capacity*max_load_numerator;
+	if (result == PROBE_RESULT_MAP_FULL || (result == PROBE_RESULT_MAP_NOT_FULL && !is_reused && over_load)) {
+		// If removed buckets are most of the load, rehashing at the same capacity is enough to clear them.
+		if (header->removed_count > header->buckets_count) {
+			if (!rebuild(map, header->buckets_capacity, header->keys_capacity)) {
+				return false;
+			}
+		} else if (!map_set_buckets_capacity_impl(map, max(1, header->buckets_capacity*buckets_growth_factor))) {
 			return false;
 		}
 		header = get_header(map);
+		is_reused = false;
 		result = probe(map, key, &bucket_index);
 		if (result != PROBE_RESULT_MAP_NOT_FULL) {
 			return false;
@@ -247,10 +296,12 @@ bool map_add_impl(void **map, char *key, void *value) {
 		if (key_index == 0) {
 			return false;
 		}
+		header = get_header(map);
 		header->key_indices[bucket_index] = key_index;
+		++header->buckets_count;
+		header->removed_count -= is_reused;
 	}
 	memcpy(header->buckets + bucket_index*header->bucket_size, value, header->bucket_size);
-	++header->buckets_count;
 	return true;
 }
 
@@ -259,29 +310,52 @@ bool map_remove_impl(void **map, char *key) {
 	size_t bucket_index = 0;
 	enum probe_result result = probe(map, key, &bucket_index);
 	if (result == PROBE_RESULT_KEY_FOUND) {
-		header->key_indices[bucket_index] = 0;
+		header->removed_keys_size += strlen(header->keys + header->key_indices[bucket_index] - 1) + 1; // Adding 1 for the null terminator.
+		header->key_indices[bucket_index] = removed_key_index;
 		--header->buckets_count;
-		if (header->buckets_count && header->buckets_count <= header->buckets_capacity/buckets_growth_factor) {
-			return map_set_buckets_capacity(map, header->buckets_count);
+		++header->removed_count;
+		// Shrink once the map is mostly empty, leaving room so the next add doesn't grow it again.
+		size_t shrink_threshold = header->buckets_capacity/(buckets_growth_factor*buckets_growth_factor);
+		if (header->buckets_count && header->buckets_count <= shrink_threshold) {
+			return map_set_buckets_capacity(map, header->buckets_capacity/buckets_growth_factor);
 		}
 		return true;
 	}
 	return false;
 }
 
+size_t map_get_removed_buckets_count_impl(void **map) {
+	struct map_header *header = get_header(map);
+	return header->removed_count;
+}
+
+size_t map_get_removed_keys_size_impl(void **map) {
+	struct map_header *header = get_header(map);
+	return header->removed_keys_size;
+}
+
+bool map_trim_impl(void **map) {
+	struct map_header *header = get_header(map);
+	size_t keys_size = header->keys_size - header->removed_keys_size;
+	if (header->removed_keys_size == 0 && header->keys_capacity == keys_size) {
+		return true;
+	}
+	return rebuild(map, header->buckets_capacity, max(1, keys_size));
+}
+
 char *map_get_key_impl(void **map, void *bucket) {
 	struct map_header *header = get_header(map);
 	ptrdiff_t bucket_index = ((char*)bucket - header->buckets)/header->bucket_size;
-	size_t key_index = header->key_indices[bucket_index];
-	if (!key_index) {
+	if (!bucket_is_full(header, bucket_index)) {
 		return NULL;
 	}
+	size_t key_index = header->key_indices[bucket_index];
 	return header->keys + key_index - 1; // Subtracting 1 because key indices are offset by +1.
 }
 
 bool map_index_is_full_impl(void **map, size_t bucket_index) {
 	struct map_header *header = get_header(map);
-	return bucket_index < header->buckets_capacity && header->key_indices[bucket_index];
+	return bucket_index < header->buckets_capacity && bucket_is_full(header, bucket_index);
 }
 
 #undef max
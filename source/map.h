@@ -4,6 +4,10 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include "memory.h"
+
+// The map's memory is counted against the subsystem of the source file that calls this.
+#define map_create(buckets_capacity, bucket_size, keys_capacity) (map_create_impl((buckets_capacity), (bucket_size), (keys_capacity), MEMORY_SUBSYSTEM))
 
 #define map_destroy(map) (map_destroy_impl((void**)(map)))
 
@@ -15,6 +19,10 @@
 
 #define map_get_buckets_count(map) (map_get_buckets_count_impl((void**)(map)))
 
+// Returns how many buckets hold a removed key. Probes walk past these, so they count toward the load
+// that makes the map rebuild.
+#define map_get_removed_buckets_count(map) (map_get_removed_buckets_count_impl((void**)(map)))
+
 #define map_get_bucket_size(map) (map_get_bucket_size_impl((void**)(map)))
 
 #define map_get_keys_capacity(map) (map_get_keys_capacity_impl((void**)(map)))
@@ -25,6 +33,14 @@
 
 #define map_get_keys_size(map) (map_get_keys_size_impl((void**)(map)))
 
+// Returns how many bytes of the key buffer are taken by keys that were removed. `map_trim` gives them
+// back.
+#define map_get_removed_keys_size(map) (map_get_removed_keys_size_impl((void**)(map)))
+
+// Rebuilds the map's key buffer without removed keys or unused capacity. Returns false if memory
+// error.
+#define map_trim(map) (map_trim_impl((void**)(map)))
+
 #define map_is_empty(map) (map_is_empty_impl((void**)(map)))
 
 #define map_get(map, key) (map_get_impl((void**)(map), (key)))
@@ -45,7 +61,7 @@ extern const size_t buckets_growth_factor;
 
 extern const size_t keys_growth_factor;
 
-void *map_create(size_t buckets_capacity, size_t bucket_size, size_t keys_capacity);
+void *map_create_impl(size_t buckets_capacity, size_t bucket_size, size_t keys_capacity, enum memory_subsystem subsystem);
 
 void map_destroy_impl(void **map);
 
@@ -55,6 +71,8 @@ bool map_set_buckets_capacity_impl(void **map, size_t capacity);
 
 size_t map_get_buckets_count_impl(void **map);
 
+size_t map_get_removed_buckets_count_impl(void **map);
+
 size_t map_get_bucket_size_impl(void **map);
 
 size_t map_get_keys_capacity_impl(void **map);
@@ -63,6 +81,10 @@ bool map_set_keys_capacity_impl(void **map, size_t capacity);
 
 size_t map_get_keys_size_impl(void **map);
 
+size_t map_get_removed_keys_size_impl(void **map);
+
+bool map_trim_impl(void **map);
+
 bool map_is_empty_impl(void **map);
 
 void *map_get_impl(void **map, char *key);
@@ -0,0 +1,90 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include "memory.h"
+
+static char *subsystem_names[MEMORY_SUBSYSTEM_COUNT] = {
+	[MEMORY_SUBSYSTEM_OTHER] = "other",
+	[MEMORY_SUBSYSTEM_BUFFER] = "buffer",
+	[MEMORY_SUBSYSTEM_DIFF] = "diff",
+	[MEMORY_SUBSYSTEM_EDITOR] = "editor",
+	[MEMORY_SUBSYSTEM_FILE_BROWSER] = "file browser",
+	[MEMORY_SUBSYSTEM_JOURNAL] = "journal",
+	[MEMORY_SUBSYSTEM_REPLACE] = "replace",
+	[MEMORY_SUBSYSTEM_WATCHER] = "watcher",
+};
+
+static struct memory_counters counters[MEMORY_SUBSYSTEM_COUNT];
+
+void memory_count(enum memory_subsystem subsystem, size_t old_size, size_t new_size) {
+	struct memory_counters *subsystem_counters = counters + subsystem;
+	// Relaxed, because nothing else is ordered by these.
+	__atomic_add_fetch(&subsystem_counters->live_bytes, new_size - old_size, __ATOMIC_RELAXED);
+	if (old_size == 0) {
+		__atomic_add_fetch(&subsystem_counters->live_count, 1, __ATOMIC_RELAXED);
+	} else if (new_size == 0) {
+		__atomic_sub_fetch(&subsystem_counters->live_count, 1, __ATOMIC_RELAXED);
+	}
+	if (new_size) {
+		__atomic_add_fetch(&subsystem_counters->allocation_count, 1, __ATOMIC_RELAXED);
+	}
+}
+
+void memory_get_counters(enum memory_subsystem subsystem, struct memory_counters *result) {
+	struct memory_counters *subsystem_counters = counters + subsystem;
+	*result = (struct memory_counters){
+		.live_bytes = __atomic_load_n(&subsystem_counters->live_bytes, __ATOMIC_RELAXED),
+		.live_count = __atomic_load_n(&subsystem_counters->live_count, __ATOMIC_RELAXED),
+		.allocation_count = __atomic_load_n(&subsystem_counters->allocation_count, __ATOMIC_RELAXED),
+	};
+}
+
+char *memory_get_subsystem_name(enum memory_subsystem subsystem) {
+	return subsystem_names[subsystem];
+}
+
+void memory_write_counters(FILE *file) {
+	for (int i = 0; i < MEMORY_SUBSYSTEM_COUNT; ++i) {
+		struct memory_counters subsystem_counters;
+		memory_get_counters(i, &subsystem_counters);
+		fprintf(
+			file, "%s: %zu live bytes in %zu allocations, %zu allocations made\n",
+			subsystem_names[i], subsystem_counters.live_bytes, subsystem_counters.live_count, subsystem_counters.allocation_count
+		);
+	}
+}
+
+// The sizes the allocator actually reserved are counted, since `memory_free` isn't told the size.
+void *memory_allocate_impl(enum memory_subsystem subsystem, size_t size) {
+	void *pointer = malloc(size);
+	if (pointer) {
+		memory_count(subsystem, 0, malloc_usable_size(pointer));
+	}
+	return pointer;
+}
+
+void *memory_allocate_zeroed_impl(enum memory_subsystem subsystem, size_t count, size_t size) {
+	void *pointer = calloc(count, size);
+	if (pointer) {
+		memory_count(subsystem, 0, malloc_usable_size(pointer));
+	}
+	return pointer;
+}
+
+char *memory_duplicate_string_impl(enum memory_subsystem subsystem, char *string) {
+	size_t size = strlen(string) + 1;
+	char *duplicate = memory_allocate_impl(subsystem, size);
+	if (duplicate) {
+		memcpy(duplicate, string, size);
+	}
+	return duplicate;
+}
+
+void memory_free_impl(enum memory_subsystem subsystem, void *pointer) {
+	if (pointer) {
+		memory_count(subsystem, malloc_usable_size(pointer), 0);
+		free(pointer);
+	}
+}
@@ -0,0 +1,66 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Which part of the editor made an allocation.
+enum memory_subsystem {
+	MEMORY_SUBSYSTEM_OTHER,
+	MEMORY_SUBSYSTEM_BUFFER,
+	MEMORY_SUBSYSTEM_DIFF,
+	MEMORY_SUBSYSTEM_EDITOR,
+	MEMORY_SUBSYSTEM_FILE_BROWSER,
+	MEMORY_SUBSYSTEM_JOURNAL,
+	MEMORY_SUBSYSTEM_REPLACE,
+	MEMORY_SUBSYSTEM_WATCHER,
+	MEMORY_SUBSYSTEM_COUNT,
+};
+
+// Lists, maps, and the allocation functions below count their memory against the subsystem of the
+// source file that creates them. A source file names its subsystem by defining MEMORY_SUBSYSTEM before
+// including anything.
+#ifndef MEMORY_SUBSYSTEM
+#define MEMORY_SUBSYSTEM MEMORY_SUBSYSTEM_OTHER
+#endif
+
+// Like `malloc`, but counted. Free with `memory_free`.
+#define memory_allocate(size) (memory_allocate_impl(MEMORY_SUBSYSTEM, (size)))
+
+// Like `calloc`, but counted. Free with `memory_free`.
+#define memory_allocate_zeroed(count, size) (memory_allocate_zeroed_impl(MEMORY_SUBSYSTEM, (count), (size)))
+
+// Like `strdup`, but counted. Free with `memory_free`.
+#define memory_duplicate_string(string) (memory_duplicate_string_impl(MEMORY_SUBSYSTEM, (string)))
+
+// Must be called from a source file with the same subsystem as the one that allocated `pointer`. Does
+// nothing if `pointer` is NULL.
+#define memory_free(pointer) (memory_free_impl(MEMORY_SUBSYSTEM, (pointer)))
+
+struct memory_counters {
+	size_t live_bytes;
+	size_t live_count; // Allocations that haven't been freed.
+	size_t allocation_count; // Allocations and reallocations since the program started.
+};
+
+// Records that an allocation of `old_size` bytes now has `new_size` bytes. An `old_size` of 0 means
+// it was just allocated, and a `new_size` of 0 means it was freed. Safe to call from any thread.
+void memory_count(enum memory_subsystem subsystem, size_t old_size, size_t new_size);
+
+void memory_get_counters(enum memory_subsystem subsystem, struct memory_counters *counters);
+
+// Returns the subsystem's name, for reports.
+char *memory_get_subsystem_name(enum memory_subsystem subsystem);
+
+// Writes every subsystem's counters to `file`, one subsystem per line.
+void memory_write_counters(FILE *file);
+
+void *memory_allocate_impl(enum memory_subsystem subsystem, size_t size);
+
+void *memory_allocate_zeroed_impl(enum memory_subsystem subsystem, size_t count, size_t size);
+
+char *memory_duplicate_string_impl(enum memory_subsystem subsystem, char *string);
+
+void memory_free_impl(enum memory_subsystem subsystem, void *pointer);
+
+#endif // MEMORY_H
@@ -0,0 +1,328 @@
+#define _GNU_SOURCE
+#define MEMORY_SUBSYSTEM MEMORY_SUBSYSTEM_REPLACE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "replace.h"
+#include "buffer.h"
+#include "journal.h"
+#include "list.h"
+#include "memory.h"
+
+#define min(a, b) (((a) <= (b)) ? (a) : (b))
+#define max(a, b) (((a) >= (b)) ? (a) : (b))
+
+// Fewer lines than this per thread isn't worth starting a thread for.
+static const uint32_t min_lines_per_replace_thread = 16*1024;
+
+static const size_t initial_replaced_lines_capacity = 64;
+
+static const size_t initial_match_xs_capacity = 256;
+
+// Rewrites one slice of the buffer's rows. Only reads the buffer, and only writes its own lists.
+struct replace_task {
+	pthread_t thread;
+	struct buffer *buffer;
+	uint32_t *line_indices; // The line index of every row.
+	uint32_t begin_y;
+	uint32_t end_y;
+	char8 *pattern;
+	uint32_t pattern_length;
+	char8 *text;
+	uint32_t text_length;
+	struct replaced_line *lines; // Points to a list. `first_match_index` is into this task's `match_xs`.
+	uint32_t *match_xs; // Points to a list.
+	bool failed;
+};
+
+static void *run_replace_task(void *argument) {
+	struct replace_task *task = argument;
+	struct buffer *buffer = task->buffer;
+	int64_t difference = (int64_t)task->text_length - task->pattern_length;
+	for (uint32_t y = task->begin_y; y < task->end_y; ++y) {
+		uint32_t line_index = task->line_indices[y];
+		struct line *line = buffer->lines + line_index;
+		char8 *end = line->text + line_get_length(line);
+		char8 *found = memmem(line->text, end - line->text, task->pattern, task->pattern_length);
+		if (!found) {
+			continue;
+		}
+		uint32_t first_match_index = list_get_count(&task->match_xs);
+		for (; found; found = memmem(found + task->pattern_length, end - found - task->pattern_length, task->pattern, task->pattern_length)) {
+			uint32_t x = found - line->text;
+			if (!list_push_back(&task->match_xs, &x)) {
+				task->failed = true;
+				return NULL;
+			}
+		}
+
+		uint32_t match_count = list_get_count(&task->match_xs) - first_match_index;
+		uint32_t length = line_get_length(line) + difference*match_count;
+		char8 *text = list_create(length + 1, sizeof *text);
+		if (!text) {
+			task->failed = true;
+			return NULL;
+		}
+		char8 *destination = text;
+		uint32_t copied_x = 0;
+		for (uint32_t i = 0; i < match_count; ++i) {
+			uint32_t x = task->match_xs[first_match_index + i];
+			memcpy(destination, line->text + copied_x, x - copied_x);
+			destination += x - copied_x;
+			memcpy(destination, task->text, task->text_length);
+			destination += task->text_length;
+			copied_x = x + task->pattern_length;
+		}
+		memcpy(destination, line->text + copied_x, end - line->text - copied_x);
+		text[length] = '\0';
+		list_set_count(&text, length + 1);
+
+		struct replaced_line replaced = {
+			.line_index = line_index,
+			.y = y,
+			.text = text,
+			.first_match_index = first_match_index,
+			.match_count = match_count,
+		};
+		if (!list_push_back(&task->lines, &replaced)) {
+			list_destroy(&text);
+			task->failed = true;
+			return NULL;
+		}
+	}
+	return NULL;
+}
+
+// Returns the replaced line at row `y`, or NULL if that row wasn't replaced.
+static struct replaced_line *find_replaced_line(struct replacement *replacement, uint32_t y) {
+	size_t low = 0;
+	size_t high = list_get_count(&replacement->lines);
+	while (low < high) {
+		size_t middle = low + (high - low)/2;
+		if (replacement->lines[middle].y < y) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	if (low < list_get_count(&replacement->lines) && replacement->lines[low].y == y) {
+		return replacement->lines + low;
+	}
+	return NULL;
+}
+
+// Moves a mark from the line's text before the swap that was just made to the text after it. A mark
+// inside a match is kept the same distance into the text that replaced it, as far as it fits.
+static void remap_mark(struct replacement *replacement, struct mark *mark) {
+	struct replaced_line *line = find_replaced_line(replacement, mark->y);
+	if (!line) {
+		return;
+	}
+	// Undoing maps from the replaced text back to the pattern.
+	uint32_t from_length = replacement->is_undone ? replacement->text_length : replacement->pattern_length;
+	uint32_t to_length = replacement->is_undone ? replacement->pattern_length : replacement->text_length;
+	int64_t shift = 0;
+	for (uint32_t i = 0; i < line->match_count; ++i) {
+		uint32_t match_x = replacement->match_xs[line->first_match_index + i];
+		// Matches after the first have moved by the matches before them in the replaced text.
+		uint32_t from_x = replacement->is_undone ? match_x + i*((int64_t)replacement->text_length - replacement->pattern_length) : match_x;
+		if (mark->x < from_x + from_length) {
+			if (mark->x > from_x) {
+				mark->x = from_x + shift + min(mark->x - from_x, to_length);
+				return;
+			}
+			break;
+		}
+		shift += (int64_t)to_length - from_length;
+	}
+	mark->x += shift;
+}
+
+static void remap_view(struct replacement *replacement, struct buffer_view *view) {
+	if (!view) {
+		return;
+	}
+	for (size_t i = 0; i < list_get_count(&view->selections); ++i) {
+		remap_mark(replacement, &view->selections[i].start);
+		remap_mark(replacement, &view->selections[i].end);
+	}
+	for (size_t i = 0; i < list_get_count(&view->matches); ++i) {
+		remap_mark(replacement, &view->matches[i].start);
+		remap_mark(replacement, &view->matches[i].end);
+	}
+}
+
+// Exchanges each replaced line's text with the text stored for it.
+static void swap_lines(struct replacement *replacement) {
+	struct buffer *buffer = replacement->buffer;
+	buffer->is_modified = buffer->is_modified || list_get_count(&replacement->lines);
+	for (size_t i = 0; i < list_get_count(&replacement->lines); ++i) {
+		struct replaced_line *replaced = replacement->lines + i;
+		struct line *line = buffer->lines + replaced->line_index;
+		char8 *text = line->text;
+		line->text = replaced->text;
+		line->hash = 0;
+		replaced->text = text;
+	}
+}
+
+bool replace_all(struct replacement *replacement, struct buffer *buffer, struct buffer_view *view, char8 *pattern, uint32_t pattern_length, char8 *text, uint32_t text_length, uint32_t thread_count) {
+	*replacement = (struct replacement){
+		.buffer = buffer,
+		.pattern_length = pattern_length,
+		.text_length = text_length,
+	};
+	replacement->lines = list_create(initial_replaced_lines_capacity, sizeof *replacement->lines);
+	if (!replacement->lines) {
+		goto error1;
+	}
+	replacement->match_xs = list_create(initial_match_xs_capacity, sizeof *replacement->match_xs);
+	if (!replacement->match_xs) {
+		goto error2;
+	}
+	if (pattern_length == 0) {
+		return true;
+	}
+
+	// The threads split the rows evenly, so every row's line is looked up first.
+	uint32_t *line_indices = list_create(buffer->line_count, sizeof *line_indices);
+	if (!line_indices) {
+		goto error3;
+	}
+	for (uint32_t line_index = buffer->first_line_index; line_index != BUFFER_NONE; line_index = buffer->lines[line_index].next_index) {
+		list_push_back(&line_indices, &line_index);
+	}
+
+	uint32_t task_count = max(1, min(thread_count, buffer->line_count/min_lines_per_replace_thread));
+	struct replace_task *tasks = memory_allocate_zeroed(task_count, sizeof *tasks);
+	if (!tasks) {
+		goto error4;
+	}
+	bool succeeded = true;
+	uint32_t created_count = 0;
+	for (; created_count < task_count; ++created_count) {
+		struct replace_task *task = tasks + created_count;
+		*task = (struct replace_task){
+			.buffer = buffer,
+			.line_indices = line_indices,
+			.begin_y = (uint64_t)buffer->line_count*created_count/task_count,
+			.end_y = (uint64_t)buffer->line_count*(created_count + 1)/task_count,
+			.pattern = pattern,
+			.pattern_length = pattern_length,
+			.text = text,
+			.text_length = text_length,
+			.lines = list_create(initial_replaced_lines_capacity, sizeof *task->lines),
+			.match_xs = list_create(initial_match_xs_capacity, sizeof *task->match_xs),
+		};
+		if (!task->lines || !task->match_xs) {
+			if (task->lines) {
+				list_destroy(&task->lines);
+			}
+			if (task->match_xs) {
+				list_destroy(&task->match_xs);
+			}
+			succeeded = false;
+			break;
+		}
+	}
+
+	// The calling thread rewrites the first slice.
+	if (succeeded) {
+		uint32_t started_count = 1;
+		for (; started_count < task_count; ++started_count) {
+			if (pthread_create(&tasks[started_count].thread, NULL, run_replace_task, tasks + started_count) != 0) {
+				break;
+			}
+		}
+		run_replace_task(tasks);
+		for (uint32_t i = 1; i < started_count; ++i) {
+			pthread_join(tasks[i].thread, NULL);
+		}
+		// Rewrite whatever slices didn't get a thread.
+		for (uint32_t i = started_count; i < task_count; ++i) {
+			run_replace_task(tasks + i);
+		}
+	}
+
+	// The slices are in row order, so appending them keeps the replaced lines sorted.
+	for (uint32_t i = 0; i < created_count; ++i) {
+		struct replace_task *task = tasks + i;
+		succeeded = succeeded && !task->failed;
+		uint32_t match_offset = list_get_count(&replacement->match_xs);
+		size_t count = list_get_count(&task->match_xs);
+		for (size_t j = 0; succeeded && j < count; ++j) {
+			succeeded = list_push_back(&replacement->match_xs, task->match_xs + j) != NULL;
+		}
+		count = list_get_count(&task->lines);
+		for (size_t j = 0; j < count; ++j) {
+			struct replaced_line *replaced = task->lines + j;
+			replaced->first_match_index += match_offset;
+			if (!succeeded || !list_push_back(&replacement->lines, replaced)) {
+				list_destroy(&replaced->text);
+				succeeded = false;
+			}
+		}
+		list_destroy(&task->lines);
+		list_destroy(&task->match_xs);
+	}
+	memory_free(tasks);
+	list_destroy(&line_indices);
+	if (!succeeded) {
+		goto error3;
+	}
+
+	// Nothing has touched the buffer yet, and committing can't fail, so it's journaled first.
+	if (buffer->journal && list_get_count(&replacement->lines) && !journal_record_replace(buffer->journal, pattern, pattern_length, text, text_length)) {
+		goto error3;
+	}
+	swap_lines(replacement);
+	remap_view(replacement, view);
+	return true;
+
+error4:
+	list_destroy(&line_indices);
+error3:
+	replacement_destroy(replacement);
+	return false;
+error2:
+	list_destroy(&replacement->lines);
+error1:
+	*replacement = (struct replacement){0};
+	return false;
+}
+
+bool replace_undo(struct replacement *replacement, struct buffer_view *view) {
+	struct buffer *buffer = replacement->buffer;
+	swap_lines(replacement);
+	replacement->is_undone = !replacement->is_undone;
+	remap_view(replacement, view);
+	if (!buffer->journal) {
+		return true;
+	}
+	// Undoing isn't a replacement of its own, so the journal gets each line's new text.
+	for (size_t i = 0; i < list_get_count(&replacement->lines); ++i) {
+		struct replaced_line *replaced = replacement->lines + i;
+		struct line *line = buffer->lines + replaced->line_index;
+		uint32_t old_length = list_get_count(&replaced->text) - 1; // Subtracting 1 for the null terminator.
+		struct selection old_text = {.start = {0, replaced->y}, .end = {old_length, replaced->y}};
+		if (!journal_record_delete(buffer->journal, old_text) || !journal_record_insert(buffer->journal, old_text.start, line->text, line_get_length(line))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void replacement_destroy(struct replacement *replacement) {
+	for (size_t i = 0; i < list_get_count(&replacement->lines); ++i) {
+		list_destroy(&replacement->lines[i].text);
+	}
+	list_destroy(&replacement->match_xs);
+	list_destroy(&replacement->lines);
+	*replacement = (struct replacement){0};
+}
+
+#undef min
+#undef max
@@ -0,0 +1,41 @@
+#ifndef REPLACE_H
+#define REPLACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "buffer.h"
+
+// A line whose text was rewritten by `replace_all`.
+struct replaced_line {
+	uint32_t line_index;
+	uint32_t y;
+	char8 *text; // Points to a list. The text the line doesn't have right now: its old text after replacing, its new text after undoing.
+	uint32_t first_match_index; // Index in `replacement.match_xs` of the line's first match.
+	uint32_t match_count;
+};
+
+// Every line rewritten by one `replace_all`. Kept as a single undo entry for the whole replacement.
+struct replacement {
+	struct buffer *buffer;
+	struct replaced_line *lines; // Points to a list. Ordered by row.
+	uint32_t *match_xs; // Points to a list. Where each match started in its line before replacing.
+	uint32_t pattern_length;
+	uint32_t text_length;
+	bool is_undone;
+};
+
+// Replaces every occurrence of `pattern` in the buffer with `text`. Matches don't span lines or overlap,
+// and `text` mustn't contain newlines. Lines are rewritten by up to `thread_count` threads, then
+// swapped into the buffer at once, so the buffer is unchanged if this fails. The view's selections
+// and matches are moved to match the new text if `view` isn't NULL. The replacement is recorded in
+// the buffer's journal as a single record. Returns false if memory error.
+bool replace_all(struct replacement *replacement, struct buffer *buffer, struct buffer_view *view, char8 *pattern, uint32_t pattern_length, char8 *text, uint32_t text_length, uint32_t thread_count);
+
+// Swaps the lines back to the text they had before the replacement, or redoes it if it was undone.
+// Only valid while the buffer's lines are the ones the replacement left, i.e. before any other edit
+// or `buffer_trim`. Returns false if memory error while journaling.
+bool replace_undo(struct replacement *replacement, struct buffer_view *view);
+
+void replacement_destroy(struct replacement *replacement);
+
+#endif // REPLACE_H
@@ -0,0 +1,313 @@
+#define MEMORY_SUBSYSTEM MEMORY_SUBSYSTEM_WATCHER
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include "watcher.h"
+#include "buffer.h"
+#include "file_browser.h"
+#include "list.h"
+
+static const size_t initial_watches_capacity = 1024;
+
+static const size_t initial_directory_watches_capacity = 1024;
+
+static const size_t initial_changes_capacity = 16;
+
+static const uint32_t directory_mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW;
+
+static const uint32_t buffer_mask = IN_MODIFY | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF;
+
+// Returns the watch for a watch descriptor, growing the list if needed. Returns NULL if memory error.
+static struct watch *get_watch(struct watcher *watcher, int descriptor) {
+	while ((size_t)descriptor >= list_get_count(&watcher->watches)) {
+		struct watch empty = {0};
+		if (!list_push_back(&watcher->watches, &empty)) {
+			return NULL;
+		}
+	}
+	return watcher->watches + descriptor;
+}
+
+// Watches the directory at `directory_index` in the browser and every directory under it. Returns
+// false if memory error or the watch limit was reached.
+static bool watch_directory_tree(struct watcher *watcher, uint32_t directory_index) {
+	struct file_browser *browser = watcher->browser;
+	struct directory_entry *directory = browser->directories + directory_index;
+	char path[PATH_MAX];
+	if (snprintf(path, sizeof path, "%s/%s", browser->root_path, browser->directory_paths + directory->path_index) < (int)sizeof path) {
+		int descriptor = inotify_add_watch(watcher->fd, path, directory_mask);
+		if (descriptor >= 0) {
+			struct watch *watch = get_watch(watcher, descriptor);
+			if (!watch) {
+				return false;
+			}
+			*watch = (struct watch){.directory_index = directory_index, .is_active = true};
+			while (directory_index >= list_get_count(&watcher->directory_watches)) {
+				int none = -1;
+				if (!list_push_back(&watcher->directory_watches, &none)) {
+					return false;
+				}
+			}
+			watcher->directory_watches[directory_index] = descriptor;
+		// Directories that vanished since they were read are fine, running out of watches isn't.
+		} else if (errno != ENOENT && errno != ENOTDIR && errno != EACCES) {
+			return false;
+		}
+	}
+	for (uint32_t child_index = directory->first_directory_index; child_index != FILE_BROWSER_NONE; child_index = browser->directories[child_index].next_index) {
+		if (!browser->directories[child_index].is_removed && !watch_directory_tree(watcher, child_index)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Stops watching the directory at `directory_index` in the browser and every directory under it.
+// Used when the directory leaves the tree, since its watches would follow it.
+static void unwatch_directory_tree(struct watcher *watcher, uint32_t directory_index) {
+	struct file_browser *browser = watcher->browser;
+	if (directory_index < list_get_count(&watcher->directory_watches) && watcher->directory_watches[directory_index] >= 0) {
+		int descriptor = watcher->directory_watches[directory_index];
+		inotify_rm_watch(watcher->fd, descriptor);
+		watcher->watches[descriptor] = (struct watch){0};
+		watcher->directory_watches[directory_index] = -1;
+	}
+	struct directory_entry *directory = browser->directories + directory_index;
+	for (uint32_t child_index = directory->first_directory_index; child_index != FILE_BROWSER_NONE; child_index = browser->directories[child_index].next_index) {
+		if (!browser->directories[child_index].is_removed) {
+			unwatch_directory_tree(watcher, child_index);
+		}
+	}
+}
+
+// Stops watching every directory. Needed before the browser is scanned again, since that changes
+// the directories' indices.
+static void unwatch_directories(struct watcher *watcher) {
+	for (size_t i = 0; i < list_get_count(&watcher->watches); ++i) {
+		struct watch *watch = watcher->watches + i;
+		if (watch->is_active && !watch->buffer) {
+			inotify_rm_watch(watcher->fd, i);
+			*watch = (struct watch){0};
+		}
+	}
+	list_set_count(&watcher->directory_watches, 0);
+}
+
+// Patches the browser's index for an event in a watched directory.
+static bool process_directory_event(struct watcher *watcher, struct watch *watch, struct inotify_event *event) {
+	struct file_browser *browser = watcher->browser;
+	if (!browser || !event->len) {
+		return true;
+	}
+	char *directory = browser->directory_paths + browser->directories[watch->directory_index].path_index;
+	char path[PATH_MAX];
+	if (snprintf(path, sizeof path, *directory ? "%s/%s" : "%s%s", directory, event->name) >= (int)sizeof path) {
+		return true;
+	}
+	bool is_directory = event->mask & IN_ISDIR;
+
+	if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+		if (file_browser_is_ignored(browser, path, is_directory)) {
+			return true;
+		}
+		if (!is_directory) {
+			return file_browser_add_path(browser, path);
+		}
+		// Files may have been created in the new directory before its watch was added, so the whole
+		// directory is read after watching it.
+		if (!file_browser_scan_directory(browser, path)) {
+			return false;
+		}
+		uint32_t directory_index = file_browser_find_directory(browser, path);
+		return directory_index == FILE_BROWSER_NONE || watch_directory_tree(watcher, directory_index);
+	}
+	if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+		if (is_directory) {
+			uint32_t directory_index = file_browser_find_directory(browser, path);
+			if (directory_index != FILE_BROWSER_NONE) {
+				unwatch_directory_tree(watcher, directory_index);
+			}
+			file_browser_remove_directory(browser, path);
+		} else {
+			file_browser_remove_path(browser, path);
+		}
+	}
+	return true;
+}
+
+// Reloads a buffer whose file changed and records the change. A buffer with unsaved edits keeps
+// them and is recorded as a conflict.
+static bool reload_buffer(struct watcher *watcher, struct buffer *buffer) {
+	struct buffer_change buffer_change = {.buffer = buffer};
+	if (buffer->is_modified) {
+		// Saving the buffer causes events too. The file is still the one the buffer last wrote if its
+		// size and inode are the same.
+		struct stat status;
+		if (stat(buffer->file_path, &status) == 0 && (uint64_t)status.st_size == buffer->file_size && (uint64_t)status.st_ino == buffer->file_inode) {
+			return true;
+		}
+		buffer_change.has_conflict = true;
+		return list_push_back(&watcher->changes, &buffer_change) != NULL;
+	}
+	if (!buffer_reload_file(buffer, &buffer_change.change)) {
+		return false;
+	}
+	if (buffer_change.change.removed_count == 0 && buffer_change.change.inserted_count == 0) {
+		return true;
+	}
+	return list_push_back(&watcher->changes, &buffer_change) != NULL;
+}
+
+bool watcher_initialize(struct watcher *watcher, struct file_browser *browser) {
+	*watcher = (struct watcher){.browser = browser};
+	watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watcher->fd < 0) {
+		goto error1;
+	}
+	watcher->watches = list_create(initial_watches_capacity, sizeof *watcher->watches);
+	if (!watcher->watches) {
+		goto error2;
+	}
+	watcher->directory_watches = list_create(initial_directory_watches_capacity, sizeof *watcher->directory_watches);
+	if (!watcher->directory_watches) {
+		goto error3;
+	}
+	watcher->changes = list_create(initial_changes_capacity, sizeof *watcher->changes);
+	if (!watcher->changes) {
+		goto error4;
+	}
+	return true;
+
+error4:
+	list_destroy(&watcher->directory_watches);
+error3:
+	list_destroy(&watcher->watches);
+error2:
+	close(watcher->fd);
+error1:
+	*watcher = (struct watcher){.fd = -1};
+	return false;
+}
+
+void watcher_destroy(struct watcher *watcher) {
+	list_destroy(&watcher->changes);
+	list_destroy(&watcher->directory_watches);
+	list_destroy(&watcher->watches);
+	close(watcher->fd);
+	*watcher = (struct watcher){.fd = -1};
+}
+
+bool watcher_watch_browser(struct watcher *watcher) {
+	if (!watcher->browser) {
+		return true;
+	}
+	uint32_t root_index = file_browser_find_directory(watcher->browser, "");
+	return root_index == FILE_BROWSER_NONE || watch_directory_tree(watcher, root_index);
+}
+
+bool watcher_watch_buffer(struct watcher *watcher, struct buffer *buffer) {
+	int descriptor = inotify_add_watch(watcher->fd, buffer->file_path, buffer_mask);
+	if (descriptor < 0) {
+		return false;
+	}
+	struct watch *watch = get_watch(watcher, descriptor);
+	if (!watch) {
+		inotify_rm_watch(watcher->fd, descriptor);
+		return false;
+	}
+	*watch = (struct watch){.buffer = buffer, .is_active = true};
+	return true;
+}
+
+void watcher_unwatch_buffer(struct watcher *watcher, struct buffer *buffer) {
+	for (size_t i = 0; i < list_get_count(&watcher->watches); ++i) {
+		struct watch *watch = watcher->watches + i;
+		if (watch->is_active && watch->buffer == buffer) {
+			inotify_rm_watch(watcher->fd, i);
+			*watch = (struct watch){0};
+		}
+	}
+}
+
+bool watcher_process_events(struct watcher *watcher) {
+	list_set_count(&watcher->changes, 0);
+	char events[64*1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+	bool succeeded = true;
+	bool is_overflowed = false;
+	ssize_t read_size = 0;
+	while ((read_size = read(watcher->fd, events, sizeof events)) > 0) {
+		for (ssize_t offset = 0; offset < read_size;) {
+			struct inotify_event *event = (struct inotify_event*)(events + offset);
+			offset += sizeof *event + event->len;
+			if (event->mask & IN_Q_OVERFLOW) {
+				is_overflowed = true;
+				continue;
+			}
+			if (event->wd < 0 || (size_t)event->wd >= list_get_count(&watcher->watches)) {
+				continue;
+			}
+			struct watch *watch = watcher->watches + event->wd;
+			if (!watch->is_active) {
+				continue;
+			}
+			if (event->mask & IN_IGNORED) {
+				// The kernel dropped the watch, usually because its directory was deleted.
+				if (!watch->buffer) {
+					if (watch->directory_index < list_get_count(&watcher->directory_watches) && watcher->directory_watches[watch->directory_index] == event->wd) {
+						watcher->directory_watches[watch->directory_index] = -1;
+					}
+					*watch = (struct watch){0};
+				}
+				continue;
+			}
+			// Buffers are reloaded once after the events are drained, however many writes there were.
+			if (watch->buffer) {
+				watch->is_changed = true;
+				watch->is_replaced = watch->is_replaced || (event->mask & (IN_MOVE_SELF | IN_DELETE_SELF));
+			} else if (!process_directory_event(watcher, watch, event)) {
+				succeeded = false;
+			}
+		}
+	}
+	if (read_size < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+		succeeded = false;
+	}
+
+	if (is_overflowed && watcher->browser) {
+		// Events were lost, so the index can't be patched. Read everything again. Scanning replaces the
+		// browser's root path, so it's copied first.
+		char root_path[PATH_MAX];
+		snprintf(root_path, sizeof root_path, "%s", watcher->browser->root_path);
+		unwatch_directories(watcher);
+		succeeded = file_browser_scan(watcher->browser, root_path) && watcher_watch_browser(watcher) && succeeded;
+	}
+
+	for (size_t i = 0; i < list_get_count(&watcher->watches); ++i) {
+		struct watch *watch = watcher->watches + i;
+		if (!watch->is_active || !watch->buffer || !(watch->is_changed || is_overflowed)) {
+			continue;
+		}
+		watch->is_changed = false;
+		struct buffer *buffer = watch->buffer;
+		if (watch->is_replaced) {
+			// Editors often save by writing a new file over the old one. Watch whatever file has the
+			// buffer's path now. If there's no file, the buffer is left as it is.
+			inotify_rm_watch(watcher->fd, i);
+			*watch = (struct watch){0};
+			if (!watcher_watch_buffer(watcher, buffer)) {
+				continue;
+			}
+		}
+		if (!reload_buffer(watcher, buffer)) {
+			succeeded = false;
+		}
+	}
+	return succeeded;
+}
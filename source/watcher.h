@@ -0,0 +1,53 @@
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "buffer.h"
+#include "file_browser.h"
+
+// What an inotify watch descriptor refers to.
+struct watch {
+	uint32_t directory_index; // Index of the directory in `file_browser.directories`.
+	struct buffer *buffer; // Set if the watch is on a buffer's file instead of a directory.
+	bool is_active;
+	bool is_changed; // The buffer's file changed during the current call to `watcher_process_events`.
+	bool is_replaced; // The buffer's file was moved or deleted, so the watch has to be added again.
+};
+
+// A buffer whose file changed, found by `watcher_process_events`.
+struct buffer_change {
+	struct buffer *buffer;
+	struct line_change change;
+	bool has_conflict; // The buffer has unsaved edits, so it wasn't reloaded and `change` is empty.
+};
+
+// Keeps a `file_browser` and open `buffer`s in sync with the disk using inotify.
+struct watcher {
+	int fd; // Becomes readable when there are events to process.
+	struct file_browser *browser; // May be NULL.
+	struct watch *watches; // Points to a list. Indexed by watch descriptor.
+	int *directory_watches; // Points to a list. The watch descriptor of each of the browser's directories, or -1.
+	struct buffer_change *changes; // Points to a list. Filled by `watcher_process_events`.
+};
+
+// `browser` may be NULL if only buffers are watched.
+bool watcher_initialize(struct watcher *watcher, struct file_browser *browser);
+
+void watcher_destroy(struct watcher *watcher);
+
+// Watches every directory in the browser's index. Call after `file_browser_scan`. Returns false if
+// memory error or the watch limit was reached.
+bool watcher_watch_browser(struct watcher *watcher);
+
+// Watches the buffer's file so it's reloaded when it changes. Returns false if memory or IO error.
+bool watcher_watch_buffer(struct watcher *watcher, struct buffer *buffer);
+
+void watcher_unwatch_buffer(struct watcher *watcher, struct buffer *buffer);
+
+// Reads pending events without blocking. New and removed paths are patched into the browser's index
+// and changed buffers are reloaded and listed in `watcher->changes`. Buffers with unsaved edits are
+// listed as conflicts instead of being reloaded. Returns false if memory or IO error.
+bool watcher_process_events(struct watcher *watcher);
+
+#endif // WATCHER_H
@@ -0,0 +1,154 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bench.h"
+#include "list.h"
+
+struct benchmark_result {
+	char name[64];
+	uint64_t operation_count;
+	uint64_t median; // In nanoseconds.
+	uint64_t deviation; // Median absolute deviation, in nanoseconds.
+	uint64_t fastest; // In nanoseconds.
+	uint64_t budget; // In nanoseconds per operation. 0 if the benchmark has none.
+};
+
+// Runs before measuring, so caches, the allocator, and the CPU's clock settle.
+static const uint32_t warmup_count = 2;
+
+static const uint32_t run_count = 11;
+
+static struct benchmark_result *results; // Points to a list.
+static char *results_path;
+static char *name_filter;
+static uint64_t start_time;
+static uint64_t stop_time;
+static volatile uint64_t sink;
+
+static uint64_t get_time(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (uint64_t)time.tv_sec*1000000000 + time.tv_nsec;
+}
+
+static int compare_times(const void *a, const void *b) {
+	uint64_t x = *(uint64_t*)a;
+	uint64_t y = *(uint64_t*)b;
+	return (x > y) - (x < y);
+}
+
+// Sorts the times.
+static uint64_t get_median(uint64_t *times, uint32_t count) {
+	qsort(times, count, sizeof *times, compare_times);
+	if (count%2) {
+		return times[count/2];
+	}
+	return (times[count/2 - 1] + times[count/2])/2;
+}
+
+// Runs the benchmark once and returns how long it took.
+static uint64_t time_run(benchmark_case benchmark) {
+	stop_time = 0;
+	start_time = get_time();
+	benchmark();
+	if (!stop_time) {
+		stop_time = get_time();
+	}
+	return stop_time - start_time;
+}
+
+static bool is_within_budget(struct benchmark_result *result) {
+	return result->median <= result->budget*result->operation_count;
+}
+
+static bool write_results(char *path) {
+	FILE *file = fopen(path, "w");
+	if (!file) {
+		return false;
+	}
+	fprintf(file, "{\n\t\"warmup_runs\": %u,\n\t\"runs\": %u,\n\t\"benchmarks\": [", warmup_count, run_count);
+	for (size_t i = 0; i < list_get_count(&results); ++i) {
+		struct benchmark_result *result = results + i;
+		fprintf(
+			file,
+			"%s\n\t\t{\"name\": \"%s\", \"operations\": %" PRIu64 ", \"median_ns\": %" PRIu64 ", \"mad_ns\": %" PRIu64 ", \"min_ns\": %" PRIu64 ", \"median_ns_per_operation\": %.3f",
+			i ? "," : "", result->name, result->operation_count, result->median, result->deviation, result->fastest,
+			(double)result->median/result->operation_count
+		);
+		if (result->budget) {
+			fprintf(file, ", \"budget_ns_per_operation\": %" PRIu64 ", \"within_budget\": %s", result->budget, is_within_budget(result) ? "true" : "false");
+		}
+		fprintf(file, "}");
+	}
+	fprintf(file, "\n\t]\n}\n");
+	return fclose(file) == 0;
+}
+
+void begin_benchmarking(char *json_path, char *filter) {
+	results = list_create(64, sizeof *results);
+	results_path = json_path;
+	name_filter = filter;
+	printf("%-40s %14s %12s %14s\n", "BENCHMARK", "MEDIAN (ns)", "MAD (ns)", "ns/op");
+}
+
+int end_benchmarking(void) {
+	int exit_code = 0;
+	if (results_path && !write_results(results_path)) {
+		printf("Couldn't write %s.\n", results_path);
+		exit_code = 1;
+	}
+	list_destroy(&results);
+	return exit_code;
+}
+
+void run_benchmark_impl(benchmark_case benchmark, uint64_t operation_count, char *name) {
+	run_benchmark_with_budget_impl(benchmark, operation_count, 0, name);
+}
+
+void run_benchmark_with_budget_impl(benchmark_case benchmark, uint64_t operation_count, uint64_t budget, char *name) {
+	if (name_filter && !strstr(name, name_filter)) {
+		return;
+	}
+	for (uint32_t i = 0; i < warmup_count; ++i) {
+		time_run(benchmark);
+	}
+	uint64_t times[run_count];
+	for (uint32_t i = 0; i < run_count; ++i) {
+		times[i] = time_run(benchmark);
+	}
+
+	struct benchmark_result result = {.operation_count = operation_count ? operation_count : 1, .budget = budget};
+	snprintf(result.name, sizeof result.name, "%s", name);
+	result.median = get_median(times, run_count);
+	result.fastest = times[0];
+	for (uint32_t i = 0; i < run_count; ++i) {
+		times[i] = times[i] > result.median ? times[i] - result.median : result.median - times[i];
+	}
+	result.deviation = get_median(times, run_count);
+	list_push_back(&results, &result);
+	printf(
+		"%-40s %14" PRIu64 " %12" PRIu64 " %14.3f",
+		result.name, result.median, result.deviation, (double)result.median/result.operation_count
+	);
+	if (budget) {
+		printf("  %s budget of %" PRIu64 " ns/op", is_within_budget(&result) ? "within" : "OVER", budget);
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+void start_timing(void) {
+	start_time = get_time();
+}
+
+void stop_timing(void) {
+	stop_time = get_time();
+}
+
+void consume(uint64_t value) {
+	sink += value;
+}
@@ -0,0 +1,44 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Runs a benchmark named after its function. `operation_count` is how many operations one run does,
+// used to report the time per operation.
+#define run_benchmark(benchmark, operation_count) (run_benchmark_impl((benchmark), (operation_count), #benchmark))
+
+// Like `run_benchmark`, but also reports whether the median time per operation is within `budget`
+// nanoseconds, for operations that have to fit in a frame.
+#define run_benchmark_with_budget(benchmark, operation_count, budget) (run_benchmark_with_budget_impl((benchmark), (operation_count), (budget), #benchmark))
+
+// The function signature for a benchmark. The whole call is timed unless it calls `start_timing` and
+// `stop_timing`.
+typedef void (*benchmark_case)(void);
+
+// Setup the results tracked by benchmarks. Results are written as JSON to `json_path` by
+// `end_benchmarking` if it isn't NULL. Only benchmarks whose names contain `filter` run if it isn't
+// NULL.
+void begin_benchmarking(char *json_path, char *filter);
+
+// Prints the results of benchmarking and writes the JSON file. Returns an exit code for `main()`.
+int end_benchmarking(void);
+
+// Warms up, then runs the benchmark repeatedly and records the median and median absolute deviation
+// of its runs. `name` is copied.
+void run_benchmark_impl(benchmark_case benchmark, uint64_t operation_count, char *name);
+
+// Like `run_benchmark_impl`, with a budget in nanoseconds per operation. A budget of 0 means none.
+void run_benchmark_with_budget_impl(benchmark_case benchmark, uint64_t operation_count, uint64_t budget, char *name);
+
+// Starts a run's timer. Work done before this, like building the data, isn't timed.
+void start_timing(void);
+
+// Stops a run's timer. Work done after this, like freeing the data, isn't timed.
+void stop_timing(void);
+
+// Keeps the compiler from optimizing away work whose result is otherwise unused.
+void consume(uint64_t value);
+
+#endif // BENCH_H
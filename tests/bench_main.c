@@ -0,0 +1,379 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "bench.h"
+#include "buffer.h"
+#include "diff.h"
+#include "file_browser.h"
+#include "list.h"
+#include "map.h"
+#include "replace.h"
+
+static const uint32_t list_push_count = 1000000;
+
+static const size_t map_buckets_capacity = 64*1024;
+
+static const double map_load_factors[] = {0.25, 0.5, 0.7};
+
+static const uint32_t corpus_line_count = 100000;
+
+static const uint32_t corpus_max_line_length = 120;
+
+static const uint32_t edit_count = 10000;
+
+static const uint32_t jump_count = 1000;
+
+// About the size of a large monorepo.
+static const uint32_t index_path_count = 2000000;
+
+static const uint32_t index_max_depth = 6;
+
+static const uint32_t max_file_matches = 50;
+
+// A keystroke has to be ranked within a frame at 60 Hz.
+static const uint64_t file_search_budget = 16*1000*1000;
+
+static char *path_words[] = {
+	"source", "tests", "include", "lib", "docs", "core", "util", "net", "render", "audio", "input",
+	"platform", "editor", "buffer", "view", "parser", "lexer", "widget", "config", "storage", "server",
+	"client", "shader", "texture", "memory", "thread", "journal", "search", "index", "schema",
+};
+
+static char *path_extensions[] = {".c", ".h", ".cpp", ".py", ".md", ".json", ".txt", ".go"};
+
+// Typed a character at a time, so each search after the first narrows the one before.
+static char *typed_query = "srcbufview";
+
+static uint64_t random_state = 0x9e3779b97f4a7c15;
+
+// The same keys are used for every map benchmark, so each one measures the map and not `snprintf`.
+static char *keys; // Points to a list. Null terminated keys, one after another.
+static char *missing_keys; // Points to a list.
+static uint32_t key_count; // How many keys the current map benchmark uses.
+
+static void *map;
+static char corpus_path[] = "/tmp/bench_corpusXXXXXX";
+static struct buffer corpus; // Loaded once and only read.
+static struct buffer edited;
+static uint32_t *jump_rows; // Points to a list.
+static struct file_browser file_index; // Filled once and only searched.
+
+// Xorshift, so corpora are the same on every run and every machine.
+static uint64_t get_random(void) {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+	return random_state;
+}
+
+static char *make_keys(char *prefix, uint32_t count) {
+	char *made = list_create(count*16, sizeof *made);
+	char key[32];
+	for (uint32_t i = 0; i < count; ++i) {
+		int length = snprintf(key, sizeof key, "%s%u", prefix, i);
+		for (int j = 0; j <= length; ++j) {
+			list_push_back(&made, key + j);
+		}
+	}
+	return made;
+}
+
+// Writes lines of random lowercase words to `corpus_path`.
+static void make_corpus(void) {
+	close(mkstemp(corpus_path));
+	FILE *file = fopen(corpus_path, "w");
+	char line[corpus_max_line_length + 2];
+	for (uint32_t y = 0; y < corpus_line_count; ++y) {
+		uint32_t length = get_random()%corpus_max_line_length;
+		for (uint32_t x = 0; x < length; ++x) {
+			uint64_t random = get_random();
+			line[x] = random%6 == 0 ? ' ' : 'a' + random%26;
+		}
+		line[length] = '\n';
+		fwrite(line, 1, length + 1, file);
+	}
+	fclose(file);
+}
+
+static void bench_list_push(void) {
+	uint32_t *list = list_create(1, sizeof *list);
+	start_timing();
+	for (uint32_t i = 0; i < list_push_count; ++i) {
+		list_push_back(&list, &i);
+	}
+	stop_timing();
+	consume(list_get_count(&list));
+	list_destroy(&list);
+}
+
+static void bench_list_push_reserved(void) {
+	uint32_t *list = list_create(list_push_count, sizeof *list);
+	start_timing();
+	for (uint32_t i = 0; i < list_push_count; ++i) {
+		list_push_back(&list, &i);
+	}
+	stop_timing();
+	consume(list_get_count(&list));
+	list_destroy(&list);
+}
+
+static void add_keys(void) {
+	char *key = keys;
+	for (uint32_t i = 0; i < key_count; ++i) {
+		map_add(&map, key, &i);
+		key += strlen(key) + 1;
+	}
+}
+
+static void fill_map(void) {
+	map = map_create(map_buckets_capacity, sizeof(uint32_t), key_count*16);
+	add_keys();
+}
+
+// Only the adds are timed, not creating the map.
+static void bench_map_add(void) {
+	map = map_create(map_buckets_capacity, sizeof(uint32_t), key_count*16);
+	start_timing();
+	add_keys();
+	stop_timing();
+	consume(map_get_buckets_count(&map));
+	map_destroy(&map);
+}
+
+static void bench_map_get(void) {
+	fill_map();
+	start_timing();
+	uint64_t total = 0;
+	char *key = keys;
+	for (uint32_t i = 0; i < key_count; ++i) {
+		total += *(uint32_t*)map_get(&map, key);
+		key += strlen(key) + 1;
+	}
+	stop_timing();
+	consume(total);
+	map_destroy(&map);
+}
+
+static void bench_map_miss(void) {
+	fill_map();
+	start_timing();
+	uint64_t total = 0;
+	char *key = missing_keys;
+	for (uint32_t i = 0; i < key_count; ++i) {
+		total += map_get(&map, key) != NULL;
+		key += strlen(key) + 1;
+	}
+	stop_timing();
+	consume(total);
+	map_destroy(&map);
+}
+
+static void bench_map_remove(void) {
+	fill_map();
+	start_timing();
+	char *key = keys;
+	for (uint32_t i = 0; i < key_count; ++i) {
+		map_remove(&map, key);
+		key += strlen(key) + 1;
+	}
+	stop_timing();
+	consume(map_get_buckets_count(&map));
+	map_destroy(&map);
+}
+
+static void bench_buffer_load(void) {
+	buffer_initialize(&edited, corpus_line_count, 16);
+	start_timing();
+	buffer_load_file(&edited, corpus_path);
+	stop_timing();
+	consume(edited.line_count);
+	buffer_destroy(&edited);
+}
+
+// Types into the middle of lines near the middle of the buffer.
+static void bench_buffer_insert_middle(void) {
+	buffer_initialize(&edited, corpus_line_count, 16);
+	buffer_load_file(&edited, corpus_path);
+	start_timing();
+	for (uint32_t i = 0; i < edit_count; ++i) {
+		uint32_t y = corpus_line_count/2 + i%64;
+		uint32_t x = line_get_length(edited.lines + buffer_get_line_index(&edited, y))/2;
+		buffer_insert_text(&edited, (struct mark){x, y}, (char8*)"x", 1, NULL);
+	}
+	stop_timing();
+	consume(edited.line_count);
+	buffer_destroy(&edited);
+}
+
+static void bench_buffer_jump_random(void) {
+	uint64_t total = 0;
+	for (uint32_t i = 0; i < jump_count; ++i) {
+		total += buffer_get_line_index(&corpus, jump_rows[i]);
+	}
+	consume(total);
+}
+
+// Moves a page at a time, like scrolling.
+static void bench_buffer_jump_page(void) {
+	uint64_t total = 0;
+	for (uint32_t y = 0; y < corpus_line_count; y += 50) {
+		total += buffer_get_line_index(&corpus, y);
+	}
+	consume(total);
+}
+
+// Replaces a common letter, which rewrites nearly every line.
+static void bench_replace_all(void) {
+	buffer_initialize(&edited, corpus_line_count, 16);
+	buffer_load_file(&edited, corpus_path);
+	struct replacement replacement;
+	start_timing();
+	replace_all(&replacement, &edited, NULL, (char8*)"e", 1, (char8*)"E!", 2, sysconf(_SC_NPROCESSORS_ONLN));
+	stop_timing();
+	consume(list_get_count(&replacement.match_xs));
+	replacement_destroy(&replacement);
+	buffer_destroy(&edited);
+}
+
+static void bench_diff_hash_file(void) {
+	struct diff diff;
+	diff_initialize(&diff);
+	start_timing();
+	diff_set_old_file(&diff, corpus_path);
+	stop_timing();
+	consume(list_get_count(&diff.old_hashes));
+	diff_destroy(&diff);
+}
+
+// Diffs against the file after typing a character, once every line's hash is cached.
+static void bench_diff_after_edit(void) {
+	buffer_initialize(&edited, corpus_line_count, 16);
+	buffer_load_file(&edited, corpus_path);
+	struct diff diff;
+	diff_initialize(&diff);
+	diff_set_old_file(&diff, corpus_path);
+	diff_start(&diff, &edited);
+	buffer_insert_text(&edited, (struct mark){0, corpus_line_count/2}, (char8*)"x", 1, NULL);
+	start_timing();
+	diff_start(&diff, &edited);
+	diff_step(&diff, UINT64_MAX);
+	stop_timing();
+	consume(list_get_count(&diff.hunks));
+	diff_destroy(&diff);
+	buffer_destroy(&edited);
+}
+
+static void search(char *pattern) {
+	struct buffer_view view;
+	buffer_view_initialize(&view, &corpus, 80, 24);
+	start_timing();
+	buffer_view_find(&view, (char8*)pattern, strlen(pattern));
+	stop_timing();
+	consume(list_get_count(&view.matches));
+	buffer_view_destroy(&view);
+}
+
+static void bench_search_rare(void) {
+	search("qxz");
+}
+
+static void bench_search_common(void) {
+	search("e");
+}
+
+// Adds paths made of random directory and file names to `file_index`, without touching the disk.
+static void make_file_index(void) {
+	file_browser_initialize(&file_index, index_path_count, sysconf(_SC_NPROCESSORS_ONLN));
+	uint32_t word_count = sizeof path_words/sizeof *path_words;
+	uint32_t extension_count = sizeof path_extensions/sizeof *path_extensions;
+	char path[256];
+	for (uint32_t i = 0; i < index_path_count; ++i) {
+		int length = 0;
+		uint32_t depth = 1 + get_random()%index_max_depth;
+		for (uint32_t j = 0; j < depth; ++j) {
+			length += snprintf(path + length, sizeof path - length, "%s%u/", path_words[get_random()%word_count], (uint32_t)(get_random()%8));
+		}
+		snprintf(
+			path + length, sizeof path - length, "%s_%s%u%s",
+			path_words[get_random()%word_count], path_words[get_random()%word_count], i, path_extensions[get_random()%extension_count]
+		);
+		file_browser_add_path(&file_index, path);
+	}
+}
+
+// Searches the whole index, like the first character typed into an empty query.
+static void bench_file_search_full(void) {
+	file_index.has_candidates = false;
+	file_browser_search(&file_index, "bufc", max_file_matches);
+	consume(list_get_count(&file_index.matches));
+}
+
+// Types `typed_query` one character at a time and searches after each.
+static void bench_file_search_typing(void) {
+	char query[32];
+	size_t length = strlen(typed_query);
+	file_index.has_candidates = false;
+	for (size_t i = 1; i <= length; ++i) {
+		memcpy(query, typed_query, i);
+		query[i] = '\0';
+		file_browser_search(&file_index, query, max_file_matches);
+		consume(list_get_count(&file_index.matches));
+	}
+}
+
+// Usage: bench [json path] [name filter]. An empty json path skips writing the JSON.
+int main(int argument_count, char **arguments) {
+	begin_benchmarking(argument_count > 1 && *arguments[1] ? arguments[1] : NULL, argument_count > 2 ? arguments[2] : NULL);
+	run_benchmark(bench_list_push, list_push_count);
+	run_benchmark(bench_list_push_reserved, list_push_count);
+
+	uint32_t max_key_count = map_buckets_capacity;
+	keys = make_keys("key", max_key_count);
+	missing_keys = make_keys("missing", max_key_count);
+	for (size_t i = 0; i < sizeof map_load_factors/sizeof *map_load_factors; ++i) {
+		key_count = map_load_factors[i]*map_buckets_capacity;
+		char name[64];
+		snprintf(name, sizeof name, "bench_map_add/load=%.2f", map_load_factors[i]);
+		run_benchmark_impl(bench_map_add, key_count, name);
+		snprintf(name, sizeof name, "bench_map_get/load=%.2f", map_load_factors[i]);
+		run_benchmark_impl(bench_map_get, key_count, name);
+		snprintf(name, sizeof name, "bench_map_miss/load=%.2f", map_load_factors[i]);
+		run_benchmark_impl(bench_map_miss, key_count, name);
+		snprintf(name, sizeof name, "bench_map_remove/load=%.2f", map_load_factors[i]);
+		run_benchmark_impl(bench_map_remove, key_count, name);
+	}
+	list_destroy(&missing_keys);
+	list_destroy(&keys);
+
+	make_corpus();
+	buffer_initialize(&corpus, corpus_line_count, 16);
+	buffer_load_file(&corpus, corpus_path);
+	jump_rows = list_create(jump_count, sizeof *jump_rows);
+	for (uint32_t i = 0; i < jump_count; ++i) {
+		uint32_t y = get_random()%corpus_line_count;
+		list_push_back(&jump_rows, &y);
+	}
+	run_benchmark(bench_buffer_load, corpus_line_count);
+	run_benchmark(bench_buffer_insert_middle, edit_count);
+	run_benchmark(bench_buffer_jump_random, jump_count);
+	run_benchmark(bench_buffer_jump_page, corpus_line_count/50);
+	run_benchmark(bench_search_rare, corpus_line_count);
+	run_benchmark(bench_search_common, corpus_line_count);
+	run_benchmark(bench_replace_all, corpus_line_count);
+	run_benchmark(bench_diff_hash_file, corpus_line_count);
+	run_benchmark(bench_diff_after_edit, corpus_line_count);
+	list_destroy(&jump_rows);
+	buffer_destroy(&corpus);
+	unlink(corpus_path);
+
+	// Building the index takes a while, so it's skipped when the filter leaves out its benchmarks.
+	if (argument_count <= 2 || strstr("bench_file_search_full bench_file_search_typing", arguments[2])) {
+		make_file_index();
+		run_benchmark_with_budget(bench_file_search_full, 1, file_search_budget);
+		run_benchmark_with_budget(bench_file_search_typing, strlen(typed_query), file_search_budget);
+		file_browser_destroy(&file_index);
+	}
+	return end_benchmarking();
+}
@@ -1,9 +1,23 @@
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <ncurses.h>
+#include <sys/stat.h>
 #include "test.h"
 #include "buffer.h"
+#include "diff.h"
+#include "editor.h"
+#include "file_browser.h"
+#include "journal.h"
 #include "list.h"
+#include "map.h"
+#include "memory.h"
+#include "replace.h"
+#include "watcher.h"
 
 struct buffer buffer;
 
@@ -15,11 +29,687 @@ void test_buffer_destroy(void) {
 	buffer_destroy(&buffer);
 }
 
+// Writes `text` to `path`, replacing the file if `append` is false.
+static void write_file(char *path, char *text, bool append) {
+	FILE *file = fopen(path, append ? "a" : "w");
+	fputs(text, file);
+	fclose(file);
+}
+
+// Returns true if the buffer's lines are the lines of `text`.
+static bool buffer_equals(struct buffer *buffer, char *text) {
+	uint32_t line_index = buffer->first_line_index;
+	uint32_t y = 0;
+	while (true) {
+		char *newline = strchr(text, '\n');
+		size_t length = newline ? (size_t)(newline - text) : strlen(text);
+		if (line_index == BUFFER_NONE || line_get_length(buffer->lines + line_index) != length || memcmp(buffer->lines[line_index].text, text, length) != 0) {
+			return false;
+		}
+		++y;
+		line_index = buffer->lines[line_index].next_index;
+		if (!newline) {
+			return line_index == BUFFER_NONE && y == buffer->line_count;
+		}
+		text = newline + 1;
+	}
+}
+
+void test_buffer_reload_file(void) {
+	char path[] = "/tmp/buffer_testXXXXXX";
+	close(mkstemp(path));
+	write_file(path, "one\ntwo\nthree\nfour\n", false);
+	struct buffer reloaded;
+	assert(buffer_initialize(&reloaded, 4, 16));
+	assert(buffer_load_file(&reloaded, path));
+	assert(buffer_equals(&reloaded, "one\ntwo\nthree\nfour\n"));
+
+	struct buffer_view view;
+	assert(buffer_view_initialize(&view, &reloaded, 80, 24));
+	view.selections[0] = (struct selection){.start = {1, 3}, .end = {2, 3}};
+	view.scroll_y = 2;
+
+	// Growing the file only appends lines.
+	struct line_change change;
+	write_file(path, "five\nsix", true);
+	assert(buffer_reload_file(&reloaded, &change));
+	assert(buffer_equals(&reloaded, "one\ntwo\nthree\nfour\nfive\nsix"));
+	assert_eq(change.y, 4, "%u", "%d");
+	assert_eq(change.inserted_count, 2, "%u", "%d");
+
+	// Replacing a line in the middle only splices that line.
+	write_file(path, "one\n2\n2.5\nthree\nfour\nfive\nsix", false);
+	assert(buffer_reload_file(&reloaded, &change));
+	assert(buffer_equals(&reloaded, "one\n2\n2.5\nthree\nfour\nfive\nsix"));
+	assert_eq(change.y, 1, "%u", "%d");
+	assert_eq(change.removed_count, 1, "%u", "%d");
+	assert_eq(change.inserted_count, 2, "%u", "%d");
+	buffer_view_apply_line_change(&view, &change);
+	assert_eq(view.selections[0].start.y, 4, "%u", "%d");
+	assert_eq(view.scroll_y, 3, "%u", "%d");
+
+	write_file(path, "", false);
+	assert(buffer_reload_file(&reloaded, &change));
+	assert(buffer_equals(&reloaded, ""));
+
+	// A rewrite in place that happens to grow the file isn't an append, even though the inode is the same.
+	write_file(path, "one\nx", false);
+	assert(buffer_reload_file(&reloaded, &change));
+	write_file(path, "two\nx\nmore", false);
+	assert(buffer_reload_file(&reloaded, &change));
+	assert(buffer_equals(&reloaded, "two\nx\nmore"));
+
+	// Random small rewrites in place, each compared against the file after reloading.
+	char *words[] = {"a", "b", "ab", "\n", "x\n"};
+	bool all_equal = true;
+	srand(1);
+	for (uint32_t i = 0; i < 500; ++i) {
+		char text[64] = "";
+		for (int j = rand()%8; j > 0; --j) {
+			strcat(text, words[rand()%(sizeof words/sizeof *words)]);
+		}
+		write_file(path, text, rand()%2);
+		all_equal = buffer_reload_file(&reloaded, &change) && all_equal;
+		FILE *file = fopen(path, "r");
+		char contents[1024];
+		contents[fread(contents, 1, sizeof contents - 1, file)] = '\0';
+		fclose(file);
+		all_equal = buffer_equals(&reloaded, contents) && all_equal;
+	}
+	assert(all_equal);
+	write_file(path, "", false);
+	assert(buffer_reload_file(&reloaded, &change));
+
+	// Saving through a symbolic link replaces the file it points to and keeps the link.
+	char link_path[64];
+	snprintf(link_path, sizeof link_path, "%s.link", path);
+	assert(symlink(path, link_path) == 0);
+	assert(buffer_load_file(&reloaded, link_path));
+	assert(buffer_insert_text(&reloaded, (struct mark){0, 0}, (char8*)"seven", 5, NULL));
+	assert(buffer_save_file(&reloaded));
+	struct stat status;
+	assert(lstat(link_path, &status) == 0 && S_ISLNK(status.st_mode));
+	assert(buffer_load_file(&reloaded, path));
+	assert(buffer_equals(&reloaded, "seven"));
+	unlink(link_path);
+
+	buffer_view_destroy(&view);
+	buffer_destroy(&reloaded);
+	unlink(path);
+}
+
+void test_buffer_edit(void) {
+	struct buffer edited;
+	assert(buffer_initialize(&edited, 4, 16));
+	struct mark end;
+	assert(buffer_insert_text(&edited, (struct mark){0, 0}, (char8*)"hello world", 11, &end));
+	assert(buffer_insert_text(&edited, (struct mark){5, 0}, (char8*)",\nbig\n", 6, &end));
+	assert(buffer_equals(&edited, "hello,\nbig\n world"));
+	assert_eq(end.y, 2, "%u", "%d");
+	assert_eq(end.x, 0, "%u", "%d");
+	assert(buffer_delete_text(&edited, (struct selection){.start = {6, 0}, .end = {1, 2}}));
+	assert(buffer_equals(&edited, "hello,world"));
+	assert(buffer_delete_text(&edited, (struct selection){.start = {5, 0}, .end = {6, 0}}));
+	assert(buffer_equals(&edited, "helloworld"));
+	buffer_destroy(&edited);
+}
+
+void test_buffer_view_find(void) {
+	struct buffer searched;
+	assert(buffer_initialize(&searched, 4, 16));
+	assert(buffer_insert_text(&searched, (struct mark){0, 0}, (char8*)"aaaa\nbab\na", 10, NULL));
+	struct buffer_view view;
+	assert(buffer_view_initialize(&view, &searched, 80, 24));
+	view.selections[0].end = (struct mark){1, 1};
+	assert(buffer_view_find(&view, (char8*)"aa", 2));
+	assert_eq(list_get_count(&view.matches), 2, "%zu", "%d");
+	assert_eq(view.matches[1].start.x, 2, "%u", "%d");
+	// No match comes after the cursor, so the current match wraps to the first.
+	assert_eq(view.current_match_index, 0, "%u", "%d");
+	assert(buffer_view_find(&view, (char8*)"a", 1));
+	assert_eq(list_get_count(&view.matches), 6, "%zu", "%d");
+	assert_eq(view.current_match_index, 4, "%u", "%d");
+	buffer_view_destroy(&view);
+	buffer_destroy(&searched);
+}
+
+void test_replace_all(void) {
+	char path[] = "/tmp/replace_testXXXXXX";
+	close(mkstemp(path));
+	write_file(path, "", false);
+	// Enough lines that the replacement is split between threads.
+	for (uint32_t i = 0; i < 40000; ++i) {
+		write_file(path, i == 20000 ? "ab, ab\n" : "-\n", true);
+	}
+	char journal_path[256];
+	assert(journal_get_path(path, journal_path, sizeof journal_path));
+	struct buffer replaced;
+	assert(buffer_initialize(&replaced, 4, 16));
+	assert(buffer_load_file(&replaced, path));
+	struct journal journal;
+	assert(journal_open(&journal, &replaced, journal_path, 5));
+	struct buffer_view view;
+	assert(buffer_view_initialize(&view, &replaced, 80, 24));
+	view.selections[0] = (struct selection){.start = {1, 20000}, .end = {5, 20000}};
+	assert(buffer_view_find(&view, (char8*)"ab", 2));
+
+	struct replacement replacement;
+	assert(replace_all(&replacement, &replaced, &view, (char8*)"ab", 2, (char8*)"xyz", 3, 4));
+	assert_eq(list_get_count(&replacement.lines), 1, "%zu", "%d");
+	assert(strcmp((char*)replaced.lines[buffer_get_line_index(&replaced, 20000)].text, "xyz, xyz") == 0);
+	assert_eq(view.selections[0].start.x, 1, "%u", "%d");
+	assert_eq(view.selections[0].end.x, 6, "%u", "%d");
+	assert_eq(view.matches[1].start.x, 5, "%u", "%d");
+	assert_eq(view.matches[1].end.x, 8, "%u", "%d");
+
+	// The whole replacement is one journal record, and replays the same way.
+	assert(journal_flush(&journal));
+	struct buffer recovered;
+	assert(buffer_initialize(&recovered, 4, 16));
+	assert(journal_recover(&recovered, path, journal_path));
+	assert(strcmp((char*)recovered.lines[buffer_get_line_index(&recovered, 20000)].text, "xyz, xyz") == 0);
+	buffer_destroy(&recovered);
+
+	assert(replace_undo(&replacement, &view));
+	assert(strcmp((char*)replaced.lines[buffer_get_line_index(&replaced, 20000)].text, "ab, ab") == 0);
+	assert_eq(view.selections[0].end.x, 5, "%u", "%d");
+	assert_eq(view.matches[1].start.x, 4, "%u", "%d");
+	assert(journal_flush(&journal));
+	assert(buffer_initialize(&recovered, 4, 16));
+	assert(journal_recover(&recovered, path, journal_path));
+	assert(strcmp((char*)recovered.lines[buffer_get_line_index(&recovered, 20000)].text, "ab, ab") == 0);
+	buffer_destroy(&recovered);
+
+	replacement_destroy(&replacement);
+	buffer_view_destroy(&view);
+	journal_close(&journal, journal_path, false);
+	buffer_destroy(&replaced);
+	unlink(path);
+}
+
+void test_buffer_trim(void) {
+	struct memory_counters before;
+	memory_get_counters(MEMORY_SUBSYSTEM_BUFFER, &before);
+	struct buffer trimmed;
+	assert(buffer_initialize(&trimmed, 64, 64));
+	for (uint32_t i = 0; i < 32; ++i) {
+		assert(buffer_insert_text(&trimmed, (struct mark){0, 0}, (char8*)"line\n", 5, NULL));
+	}
+	assert(buffer_delete_text(&trimmed, (struct selection){.start = {0, 4}, .end = {0, 28}}));
+	struct buffer_memory memory;
+	buffer_get_memory(&trimmed, &memory);
+	assert_eq(memory.free_line_count, 24, "%u", "%d");
+	assert(memory.text_slack_bytes > 0);
+
+	// A budget the slack already fits in leaves the buffer alone.
+	assert_eq(buffer_trim(&trimmed, memory.live_bytes), 0, "%zu", "%d");
+	// Compacting keeps half the budget as room for new lines.
+	assert(buffer_trim(&trimmed, 4*sizeof *trimmed.lines) > 0);
+	assert_eq(buffer_get_line_slack_bytes(&trimmed), 2*sizeof *trimmed.lines, "%zu", "%zu");
+	buffer_get_memory(&trimmed, &memory);
+	assert_eq(memory.free_line_count, 0, "%u", "%d");
+	size_t live_bytes = memory.live_bytes;
+	size_t reclaimed = buffer_trim(&trimmed, 0);
+	buffer_get_memory(&trimmed, &memory);
+	assert_eq(live_bytes - memory.live_bytes, reclaimed, "%zu", "%zu");
+	assert_eq(memory.free_line_count, 0, "%u", "%d");
+	assert_eq(memory.line_slot_count, 9, "%u", "%d");
+	assert_eq(memory.text_slack_bytes + memory.lines_slack_bytes, 0, "%zu", "%d");
+	assert(buffer_equals(&trimmed, "line\nline\nline\nline\nline\nline\nline\nline\n"));
+	assert(buffer_insert_text(&trimmed, (struct mark){2, 8}, (char8*)"end", 3, NULL));
+	assert(buffer_equals(&trimmed, "line\nline\nline\nline\nline\nline\nline\nline\nend"));
+
+	struct memory_counters during;
+	memory_get_counters(MEMORY_SUBSYSTEM_BUFFER, &during);
+	assert_eq(during.live_count - before.live_count, memory.allocation_count, "%zu", "%u");
+	buffer_destroy(&trimmed);
+	struct memory_counters after;
+	memory_get_counters(MEMORY_SUBSYSTEM_BUFFER, &after);
+	assert_eq(after.live_bytes, before.live_bytes, "%zu", "%zu");
+}
+
+static bool is_completion_run;
+
+static void run_completion(struct editor *editor, void *data) {
+	(void)editor;
+	*(bool*)data = true;
+}
+
+static void *post_completion(void *argument) {
+	editor_post_completion(argument, (struct completion){.function = run_completion, .data = &is_completion_run});
+	return NULL;
+}
+
+void test_editor_completions(void) {
+	// The editor waits on standard input for keys, so a pipe stands in for the terminal.
+	int input[2];
+	assert(pipe(input) == 0);
+	int saved_input = dup(STDIN_FILENO);
+	dup2(input[0], STDIN_FILENO);
+	FILE *output = fopen("/dev/null", "w");
+	SCREEN *screen = newterm("vt100", output, stdin);
+	assert(screen);
+	struct editor editor;
+	assert(editor_initialize(&editor));
+
+	pthread_t thread;
+	assert(pthread_create(&thread, NULL, post_completion, &editor) == 0);
+	for (uint32_t i = 0; i < 100 && !is_completion_run; ++i) {
+		editor_update(&editor);
+	}
+	pthread_join(thread, NULL);
+	assert(is_completion_run);
+
+	// Saving writes the file on another thread, and the loop finishes the save.
+	char path[] = "/tmp/editor_testXXXXXX";
+	close(mkstemp(path));
+	assert(editor_open_file(&editor, path));
+	editor_process_key(&editor, 'a');
+	editor_process_key(&editor, 's' & 0x1f);
+	assert(editor.is_saving);
+	editor_process_key(&editor, 'b');
+	for (uint32_t i = 0; i < 100 && editor.is_saving; ++i) {
+		editor_update(&editor);
+	}
+	assert(!editor.is_saving);
+	assert(strcmp(editor.message, "Saved.") == 0);
+	struct buffer saved;
+	assert(buffer_initialize(&saved, 4, 16));
+	assert(buffer_load_file(&saved, path));
+	assert(buffer_equals(&saved, "a"));
+	// The edit made during the save is still unsaved, and journaled on top of the saved file.
+	assert(editor.buffer.is_modified);
+	assert(journal_flush(&editor.journal));
+	assert(journal_recover(&saved, path, editor.journal_path));
+	assert(buffer_equals(&saved, "ab"));
+	buffer_destroy(&saved);
+
+	char journal_path[PATH_MAX];
+	snprintf(journal_path, sizeof journal_path, "%s", editor.journal_path);
+	editor_destroy(&editor);
+	endwin();
+	delscreen(screen);
+	fclose(output);
+	dup2(saved_input, STDIN_FILENO);
+	close(saved_input);
+	close(input[0]);
+	close(input[1]);
+	unlink(journal_path);
+	unlink(path);
+}
+
+void test_diff(void) {
+	char path[] = "/tmp/diff_testXXXXXX";
+	close(mkstemp(path));
+	write_file(path, "one\ntwo\nthree\nfour\nfive\nsix\n", false);
+	struct buffer edited;
+	assert(buffer_initialize(&edited, 4, 16));
+	assert(buffer_load_file(&edited, path));
+	struct diff diff;
+	assert(diff_initialize(&diff));
+	assert(diff_set_old_file(&diff, path));
+	assert(diff_start(&diff, &edited));
+	assert(diff.is_done);
+	assert_eq(list_get_count(&diff.hunks), 0, "%zu", "%d");
+
+	// Changing a line clears its cached hash.
+	assert(buffer_insert_text(&edited, (struct mark){3, 1}, (char8*)"!", 1, NULL));
+	assert(buffer_delete_text(&edited, (struct selection){.start = {0, 3}, .end = {0, 4}}));
+	assert(buffer_insert_text(&edited, (struct mark){0, 5}, (char8*)"new\n", 4, NULL));
+	assert(buffer_equals(&edited, "one\ntwo!\nthree\nfive\nsix\nnew\n"));
+	assert(diff_start(&diff, &edited));
+	diff_set_focus(&diff, 5, 1);
+	// The focused rows are diffed first.
+	while (!diff_is_final(&diff, 5, 1)) {
+		assert(diff_step(&diff, 1));
+	}
+	assert(diff_step(&diff, UINT64_MAX));
+	assert(diff.is_done);
+	assert_eq(list_get_count(&diff.hunks), 3, "%zu", "%d");
+	struct diff_hunk *hunks = diff.hunks;
+	assert(hunks[0].old_y == 1 && hunks[0].old_count == 1 && hunks[0].new_y == 1 && hunks[0].new_count == 1);
+	assert(hunks[1].old_y == 3 && hunks[1].old_count == 1 && hunks[1].new_count == 0);
+	assert(hunks[2].old_y == 6 && hunks[2].old_count == 0 && hunks[2].new_y == 5 && hunks[2].new_count == 1);
+
+	diff_destroy(&diff);
+	buffer_destroy(&edited);
+	unlink(path);
+}
+
+void test_journal_recover(void) {
+	char path[] = "/tmp/journal_testXXXXXX";
+	close(mkstemp(path));
+	write_file(path, "alpha\nbeta\n", false);
+	char journal_path[256];
+	assert(journal_get_path(path, journal_path, sizeof journal_path));
+
+	struct buffer edited;
+	assert(buffer_initialize(&edited, 4, 16));
+	assert(buffer_load_file(&edited, path));
+	struct journal journal;
+	assert(journal_open(&journal, &edited, journal_path, 5));
+	assert(buffer_insert_text(&edited, (struct mark){5, 0}, (char8*)"!\ngamma", 7, NULL));
+	assert(buffer_delete_text(&edited, (struct selection){.start = {0, 2}, .end = {2, 2}}));
+	assert(journal_flush(&journal));
+
+	// Recovering while the journal is still open is the same as recovering after a crash.
+	struct buffer recovered;
+	assert(buffer_initialize(&recovered, 4, 16));
+	assert(journal_recover(&recovered, path, journal_path));
+	assert(buffer_equals(&recovered, "alpha!\ngamma\nta\n"));
+	assert(buffer_equals(&edited, "alpha!\ngamma\nta\n"));
+
+	// Saving starts the journal over, so there's nothing left to replay.
+	assert(buffer_save_file(&edited));
+	assert(buffer_insert_text(&edited, (struct mark){0, 0}, (char8*)">", 1, NULL));
+	assert(journal_flush(&journal));
+	assert(journal_recover(&recovered, path, journal_path));
+	assert(buffer_equals(&recovered, ">alpha!\ngamma\nta\n"));
+
+	// So does reloading a file that changed on disk.
+	assert(buffer_save_file(&edited));
+	write_file(path, "delta\n", true);
+	struct line_change change;
+	assert(buffer_reload_file(&edited, &change));
+	assert(buffer_insert_text(&edited, (struct mark){0, 0}, (char8*)"<", 1, NULL));
+	assert(journal_flush(&journal));
+	assert(journal_recover(&recovered, path, journal_path));
+	assert(buffer_equals(&recovered, "<>alpha!\ngamma\nta\ndelta\n"));
+
+	// A failed write is reported until the next save, which starts the journal over and works again.
+	int journal_fd = journal.fd;
+	journal.fd = open("/dev/null", O_RDONLY);
+	assert(buffer_insert_text(&edited, (struct mark){0, 0}, (char8*)"#", 1, NULL));
+	assert(!journal_flush(&journal));
+	close(journal.fd);
+	journal.fd = journal_fd;
+	assert(buffer_save_file(&edited));
+	assert(buffer_insert_text(&edited, (struct mark){0, 0}, (char8*)"$", 1, NULL));
+	assert(journal_flush(&journal));
+	assert(journal_recover(&recovered, path, journal_path));
+	assert(buffer_equals(&recovered, "$#<>alpha!\ngamma\nta\ndelta\n"));
+
+	journal_close(&journal, journal_path, false);
+	assert(edited.journal == NULL);
+	assert(access(journal_path, F_OK) != 0);
+	buffer_destroy(&recovered);
+	buffer_destroy(&edited);
+	unlink(path);
+}
+
+void test_watcher(void) {
+	char root[] = "/tmp/watcher_testXXXXXX";
+	assert(mkdtemp(root));
+	char path[256];
+	sprintf(path, "%s/log.txt", root);
+	write_file(path, "first\n", false);
+
+	struct file_browser browser;
+	assert(file_browser_initialize(&browser, 16, 1));
+	assert(file_browser_scan(&browser, root));
+	struct buffer log;
+	assert(buffer_initialize(&log, 4, 16));
+	assert(buffer_load_file(&log, path));
+	struct watcher watcher;
+	assert(watcher_initialize(&watcher, &browser));
+	assert(watcher_watch_browser(&watcher));
+	assert(watcher_watch_buffer(&watcher, &log));
+
+	write_file(path, "second\n", true);
+	sprintf(path, "%s/new.c", root);
+	write_file(path, "", false);
+	assert(watcher_process_events(&watcher));
+	assert(buffer_equals(&log, "first\nsecond\n"));
+	assert_eq(list_get_count(&watcher.changes), 1, "%zu", "%d");
+	assert(file_browser_find_path(&browser, "new.c") != FILE_BROWSER_NONE);
+
+	// Unsaved edits aren't replaced by the file.
+	sprintf(path, "%s/log.txt", root);
+	assert(buffer_insert_text(&log, (struct mark){0, 2}, (char8*)"edit", 4, NULL));
+	write_file(path, "third\n", true);
+	assert(watcher_process_events(&watcher));
+	assert_eq(list_get_count(&watcher.changes), 1, "%zu", "%d");
+	assert(watcher.changes[0].has_conflict);
+	assert(buffer_equals(&log, "first\nsecond\nedit"));
+	assert(!buffer_reload_file(&log, &watcher.changes[0].change));
+	// Saving isn't a conflict, even though it changes the file.
+	assert(buffer_save_file(&log));
+	assert(!log.is_modified);
+	assert(watcher_process_events(&watcher));
+	assert_eq(list_get_count(&watcher.changes), 0, "%zu", "%d");
+	assert(buffer_equals(&log, "first\nsecond\nedit"));
+
+	sprintf(path, "%s/new.c", root);
+	unlink(path);
+	assert(watcher_process_events(&watcher));
+	assert(file_browser_find_path(&browser, "new.c") == FILE_BROWSER_NONE);
+
+	// A directory moved out of the tree stops being watched, and moving it back reuses its slots.
+	char outside[64];
+	sprintf(outside, "%s_outside", root);
+	sprintf(path, "%s/sub", root);
+	mkdir(path, 0700);
+	sprintf(path, "%s/sub/inner", root);
+	mkdir(path, 0700);
+	sprintf(path, "%s/sub/inner/deep.c", root);
+	write_file(path, "", false);
+	assert(watcher_process_events(&watcher));
+	assert(file_browser_find_path(&browser, "sub/inner/deep.c") != FILE_BROWSER_NONE);
+	uint32_t inner_index = file_browser_find_directory(&browser, "sub/inner");
+	assert(inner_index != FILE_BROWSER_NONE && watcher.directory_watches[inner_index] >= 0);
+	size_t directory_count = list_get_count(&browser.directories);
+	sprintf(path, "%s/sub", root);
+	assert(rename(path, outside) == 0);
+	assert(watcher_process_events(&watcher));
+	assert(file_browser_find_path(&browser, "sub/inner/deep.c") == FILE_BROWSER_NONE);
+	assert(file_browser_find_directory(&browser, "sub/inner") == FILE_BROWSER_NONE);
+	assert_eq(watcher.directory_watches[inner_index], -1, "%d", "%d");
+	sprintf(path, "%s/inner/late.c", outside);
+	write_file(path, "", false);
+	assert(watcher_process_events(&watcher));
+	assert(file_browser_find_path(&browser, "sub/inner/late.c") == FILE_BROWSER_NONE);
+	sprintf(path, "%s/sub", root);
+	assert(rename(outside, path) == 0);
+	assert(watcher_process_events(&watcher));
+	assert(file_browser_find_path(&browser, "sub/inner/deep.c") != FILE_BROWSER_NONE);
+	assert(file_browser_find_path(&browser, "sub/inner/late.c") != FILE_BROWSER_NONE);
+	assert_eq(file_browser_find_directory(&browser, "sub/inner"), inner_index, "%u", "%u");
+	assert_eq(list_get_count(&browser.directories), directory_count, "%zu", "%zu");
+	assert_eq(file_browser_remove_directory(&browser, "sub"), 2, "%u", "%d");
+	sprintf(path, "%s/sub/inner/deep.c", root);
+	unlink(path);
+	sprintf(path, "%s/sub/inner/late.c", root);
+	unlink(path);
+	sprintf(path, "%s/sub/inner", root);
+	rmdir(path);
+	sprintf(path, "%s/sub", root);
+	rmdir(path);
+
+	watcher_destroy(&watcher);
+	buffer_destroy(&log);
+	file_browser_destroy(&browser);
+	sprintf(path, "%s/log.txt", root);
+	unlink(path);
+	rmdir(root);
+}
+
+void test_map_remove_keeps_probe_chain(void) {
+	uint32_t *map = map_create(8, sizeof *map, 64);
+	assert(map);
+	char key[16];
+	for (uint32_t i = 0; i < 1000; ++i) {
+		sprintf(key, "key%u", i);
+		assert(map_add(&map, key, &i));
+	}
+	assert_eq(map_get_buckets_count(&map), 1000, "%zu", "%d");
+	for (uint32_t i = 0; i < 1000; i += 2) {
+		sprintf(key, "key%u", i);
+		assert(map_remove(&map, key));
+	}
+	for (uint32_t i = 0; i < 1000; ++i) {
+		sprintf(key, "key%u", i);
+		uint32_t *value = map_get(&map, key);
+		if (i%2) {
+			assert(value && *value == i);
+		} else {
+			assert(!value);
+		}
+	}
+	assert(map_get_removed_keys_size(&map) > 0);
+	assert(map_trim(&map));
+	assert_eq(map_get_removed_keys_size(&map), 0, "%zu", "%d");
+	assert_eq(map_get_keys_capacity(&map), map_get_keys_size(&map), "%zu", "%zu");
+	sprintf(key, "key%u", 999);
+	assert(map_get(&map, key) && *(uint32_t*)map_get(&map, key) == 999);
+	map_destroy(&map);
+}
+
+// Adding and removing keys without changing the count shouldn't fill the map with removed buckets.
+void test_map_clears_removed_buckets(void) {
+	uint32_t *map = map_create(4096, sizeof *map, 64);
+	assert(map);
+	char key[16];
+	for (uint32_t i = 0; i < 1500; ++i) {
+		sprintf(key, "key%u", i);
+		assert(map_add(&map, key, &i));
+	}
+	bool changed = true;
+	for (uint32_t i = 1500; i < 41500; ++i) {
+		sprintf(key, "key%u", i);
+		changed = changed && map_add(&map, key, &i);
+		sprintf(key, "key%u", i - 1500);
+		changed = changed && map_remove(&map, key);
+	}
+	assert(changed);
+	assert_eq(map_get_buckets_capacity(&map), 4096, "%zu", "%d");
+	assert_eq(map_get_buckets_count(&map), 1500, "%zu", "%d");
+	assert((map_get_buckets_count(&map) + map_get_removed_buckets_count(&map))*4 <= 4096*3);
+	for (uint32_t i = 40000; i < 41500; ++i) {
+		sprintf(key, "key%u", i);
+		uint32_t *value = map_get(&map, key);
+		assert(value && *value == i);
+	}
+	map_destroy(&map);
+}
+
+void test_file_browser_score(void) {
+	assert_eq(file_browser_score("xyz", "source/buffer.c", 7), INT32_MIN, "%d", "%d");
+	assert_eq(file_browser_score("", "source/buffer.c", 7), 0, "%d", "%d");
+	int32_t name_score = file_browser_score("buf", "source/buffer.c", 7);
+	int32_t scattered_score = file_browser_score("buf", "build/utils/fast.c", 12);
+	assert_else(name_score > scattered_score, "%d <= %d\n", name_score, scattered_score);
+}
+
+// Enough paths that a search is split between the pool's workers. The split search must rank the
+// same as one that runs on a single thread, including when it narrows the last search's candidates.
+void test_file_browser_search_pool(void) {
+	struct file_browser single;
+	struct file_browser pooled;
+	assert(file_browser_initialize(&single, 16, 1));
+	assert(file_browser_initialize(&pooled, 16, 4));
+	char path[64];
+	bool added = true;
+	for (uint32_t i = 0; i < 300000; ++i) {
+		sprintf(path, "module%u/file%u.c", i%977, i);
+		added = file_browser_add_path(&single, path) && file_browser_add_path(&pooled, path) && added;
+	}
+	assert(added);
+	char *queries[] = {"m9", "m9f1", "m9f12", "zz", "fi"};
+	for (size_t i = 0; i < sizeof queries/sizeof *queries; ++i) {
+		assert(file_browser_search(&single, queries[i], 20));
+		assert(file_browser_search(&pooled, queries[i], 20));
+		assert_eq(list_get_count(&pooled.matches), list_get_count(&single.matches), "%zu", "%zu");
+		for (size_t j = 0; j < list_get_count(&single.matches); ++j) {
+			assert_eq(pooled.matches[j].entry_index, single.matches[j].entry_index, "%u", "%u");
+		}
+	}
+	file_browser_destroy(&pooled);
+	file_browser_destroy(&single);
+}
+
+void test_file_browser_scan(void) {
+	char root[] = "/tmp/file_browser_testXXXXXX";
+	assert(mkdtemp(root));
+	char path[256];
+	char *files[] = {"main.c", "source/buffer.c", "source/buffer.h", "source/keep.h", "build/buffer.o", "notes.txt", "important.txt"};
+	sprintf(path, "%s/source", root);
+	mkdir(path, 0700);
+	sprintf(path, "%s/build", root);
+	mkdir(path, 0700);
+	for (size_t i = 0; i < sizeof files/sizeof *files; ++i) {
+		sprintf(path, "%s/%s", root, files[i]);
+		close(open(path, O_CREAT | O_WRONLY, 0600));
+	}
+	sprintf(path, "%s/.gitignore", root);
+	FILE *gitignore = fopen(path, "w");
+	fputs("# Build output.\nbuild/\n*.txt\n!important.txt\n", gitignore);
+	fclose(gitignore);
+	sprintf(path, "%s/source/.gitignore", root);
+	gitignore = fopen(path, "w");
+	fputs("*.h\n!keep.h\n", gitignore);
+	fclose(gitignore);
+
+	struct memory_counters before;
+	memory_get_counters(MEMORY_SUBSYSTEM_FILE_BROWSER, &before);
+	struct file_browser browser;
+	assert(file_browser_initialize(&browser, 16, 2));
+	assert(file_browser_scan(&browser, root));
+	assert_eq(list_get_count(&browser.entries), 6, "%zu", "%d");
+	assert_eq(map_get_keys_capacity(&browser.entry_indices), map_get_keys_size(&browser.entry_indices), "%zu", "%zu");
+	assert(file_browser_find_path(&browser, "source/buffer.c") != FILE_BROWSER_NONE);
+	assert(file_browser_find_path(&browser, "build/buffer.o") == FILE_BROWSER_NONE);
+	assert(file_browser_find_path(&browser, "notes.txt") == FILE_BROWSER_NONE);
+	assert(file_browser_find_path(&browser, "important.txt") != FILE_BROWSER_NONE);
+	assert(file_browser_find_path(&browser, "source/buffer.h") == FILE_BROWSER_NONE);
+	assert(file_browser_find_path(&browser, "source/keep.h") != FILE_BROWSER_NONE);
+	// The nested `.gitignore` only applies under its own directory.
+	assert(file_browser_is_ignored(&browser, "source/other.h", false));
+	assert(!file_browser_is_ignored(&browser, "other.h", false));
+	assert(file_browser_is_ignored(&browser, "source/.git", true));
+	assert(file_browser_search(&browser, "bufc", 2));
+	assert_eq(list_get_count(&browser.matches), 1, "%zu", "%d");
+	assert(strcmp(file_browser_get_path(&browser, browser.matches[0].entry_index), "source/buffer.c") == 0);
+	file_browser_destroy(&browser);
+	// Everything the scan allocated, including the walk's own allocations, was counted and given back.
+	struct memory_counters after;
+	memory_get_counters(MEMORY_SUBSYSTEM_FILE_BROWSER, &after);
+	assert_eq(after.live_bytes, before.live_bytes, "%zu", "%zu");
+	assert(after.allocation_count > before.allocation_count);
+
+	for (size_t i = 0; i < sizeof files/sizeof *files; ++i) {
+		sprintf(path, "%s/%s", root, files[i]);
+		unlink(path);
+	}
+	sprintf(path, "%s/.gitignore", root);
+	unlink(path);
+	sprintf(path, "%s/source/.gitignore", root);
+	unlink(path);
+	sprintf(path, "%s/source", root);
+	rmdir(path);
+	sprintf(path, "%s/build", root);
+	rmdir(path);
+	rmdir(root);
+}
+
 
 
 int main(void) {
 	begin_testing();
 		run_test(test_buffer_create);
+		run_test(test_map_remove_keeps_probe_chain);
+		run_test(test_map_clears_removed_buckets);
+		run_test(test_file_browser_score);
+		run_test(test_file_browser_search_pool);
+		run_test(test_file_browser_scan);
+		run_test(test_buffer_reload_file);
+		run_test(test_watcher);
+		run_test(test_buffer_edit);
+		run_test(test_buffer_view_find);
+		run_test(test_journal_recover);
+		run_test(test_replace_all);
+		run_test(test_buffer_trim);
+		run_test(test_diff);
+		run_test(test_editor_completions);
 
 
 